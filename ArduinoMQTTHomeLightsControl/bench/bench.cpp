@@ -0,0 +1,479 @@
+/*
+Switching path microbenchmarks for [env:native].
+
+  pio run -e native && .pio/build/native/program [iterations]
+
+Every scenario runs the real sketch (setup, onSwitchPressed, callback...) against NativeShim.
+Per operation it reports host time, I2C traffic, EEPROM cell writes, MQTT traffic, socket writes,
+Serial bytes and time spent blocking. Work done later by background tasks is included: after each
+operation the loop runs for settleMs of virtual time and the cost of an idle loop over the same
+period is subtracted.
+*/
+// pio test -e native builds src/ and bench/ with the tests, which have their own main()
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <chrono>
+#include "latencyStats.h"
+#include "bootStages.h"
+#include "i2cBus.h"
+#include "ledStates.h"
+#include "batchClient.h"
+#include "diagCounters.h"
+#include "publishQueue.h"
+#include "mqttConnection.h"
+#include "mqttEncoder.h"
+#include <TaskManagerIO.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define benchCycles() __rdtsc()
+#else
+#define benchCycles() 0ULL
+#endif
+
+void setup();
+void loop();
+void onSwitchPressed(uint8_t key, bool held);
+extern BatchClient mqttSocket;
+
+// a multiple of publishSweepMs: every period holds the same number of background sweep messages
+#define settleMs 15000
+
+static const uint8_t outputExpanders[] = {0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26};
+static const uint8_t inputExpanders[] = {0x38, 0x3A, 0x3C, 0x3E};
+
+struct Result
+{
+  const char* name;
+  uint32_t ops;
+  double ns;
+  double cycles;
+  ShimStats stats;
+};
+
+static void runFor(uint32_t ms)
+{
+  for (uint32_t i = 0; i < ms; i++)
+  {
+    shimAdvanceMicros(1000);
+    loop();
+  }
+}
+
+static void addStats(ShimStats& sum, const ShimStats& after, const ShimStats& before, const ShimStats* idle)
+{
+  const uint32_t* a = (const uint32_t*)&after;
+  const uint32_t* b = (const uint32_t*)&before;
+  const uint32_t* i = (const uint32_t*)idle;
+  uint32_t* s = (uint32_t*)&sum;
+  for (size_t n = 0; n < sizeof(ShimStats) / sizeof(uint32_t); n++) s[n] += a[n] - b[n] - (i ? i[n] : 0);
+}
+
+static ShimStats idleStats;
+
+static Result measure(const char* name, uint32_t iterations, void (*prepare)(uint32_t), void (*op)(uint32_t))
+{
+  Result r = {name, iterations, 0, 0, {}};
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    if (prepare)
+    {
+      prepare(n);
+      runFor(settleMs);
+    }
+    ShimStats before = shimStats;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    unsigned long long c0 = benchCycles();
+    op(n);
+    unsigned long long c1 = benchCycles();
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    runFor(settleMs);
+    r.ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    r.cycles += (double)(c1 - c0);
+    addStats(r.stats, shimStats, before, &idleStats);
+  }
+  return r;
+}
+
+// One op, then ms of loop; for events that play out over a longer time (broker outage)
+static Result window(const char* name, uint32_t ms, void (*op)(uint32_t))
+{
+  Result r = {name, 1, 0, 0, {}};
+  ShimStats idle;
+  const uint32_t* i = (const uint32_t*)&idleStats;
+  uint32_t* scaled = (uint32_t*)&idle;
+  for (size_t n = 0; n < sizeof(ShimStats) / sizeof(uint32_t); n++) scaled[n] = (uint64_t)i[n] * ms / settleMs;
+  ShimStats before = shimStats;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  op(0);
+  runFor(ms);
+  r.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  addStats(r.stats, shimStats, before, &idle);
+  return r;
+}
+
+static void printHeader()
+{
+  printf("%-28s %10s %10s %7s %8s %7s %6s %8s %7s %8s %7s\n", "scenario", "ns/op", "cycles/op", "i2c tx", "i2c B",
+         "eeprom", "mqtt", "mqtt B", "net wr", "serial B", "blk ms");
+}
+
+#define maxResults 40
+static Result results[maxResults];
+static uint8_t noOfResults = 0;
+
+static void printResult(const Result& r)
+{
+  if (noOfResults < maxResults) results[noOfResults++] = r;
+  double n = r.ops ? r.ops : 1;
+  const ShimStats& s = r.stats;
+  // signed: a window can do less than idle (no sweep messages while the broker is down)
+  printf("%-28s %10.0f %10.0f %7.1f %8.1f %7.1f %6.1f %8.1f %7.1f %8.1f %7.1f\n", r.name, r.ns / n, r.cycles / n,
+         (int32_t)s.i2cTransactions / n, (int32_t)s.i2cBytes / n, (int32_t)s.eepromWrites / n,
+         (int32_t)s.mqttPublishes / n, (int32_t)s.mqttPublishBytes / n, (int32_t)s.netWrites / n,
+         (int32_t)s.serialBytes / n, (int32_t)s.blockedMs / n);
+}
+
+// Bus time of signed stats (a window that did less than idle): the time is linear in the counts
+static double busMicros(const ShimStats& stats, uint32_t hz)
+{
+  ShimStats plus = {}, minus = {};
+  const uint32_t* s = (const uint32_t*)&stats;
+  uint32_t* p = (uint32_t*)&plus;
+  uint32_t* m = (uint32_t*)&minus;
+  for (size_t n = 0; n < sizeof(ShimStats) / sizeof(uint32_t); n++)
+  {
+    if ((int32_t)s[n] < 0) m[n] = -(int32_t)s[n];
+    else p[n] = s[n];
+  }
+  return shimI2cBusMicros(plus, hz) - shimI2cBusMicros(minus, hz);
+}
+
+// I2C traffic and bus time per operation of every scenario, at 100 and 400 kHz
+static void printI2cReport()
+{
+  printf("\n%-28s %7s %7s %7s %7s %10s %10s\n", "i2c bus per operation", "starts", "stops", "addr B", "data B",
+         "us 100kHz", "us 400kHz");
+  for (uint8_t i = 0; i < noOfResults; i++)
+  {
+    const Result& r = results[i];
+    double n = r.ops ? r.ops : 1;
+    const ShimStats& s = r.stats;
+    printf("%-28s %7.1f %7.1f %7.1f %7.1f %10.1f %10.1f\n", r.name, (int32_t)s.i2cStarts / n, (int32_t)s.i2cStops / n,
+           (int32_t)s.i2cAddressBytes / n, (int32_t)s.i2cDataBytes / n, busMicros(s, 100000) / n, busMicros(s, 400000) / n);
+  }
+  const Result& idle = results[1];
+  printf("idle polling: %.0f us of I2C per second at 100 kHz (%.3f%% of the time), %.0f us at 400 kHz\n",
+         busMicros(idle.stats, 100000) / idle.ops, busMicros(idle.stats, 100000) / idle.ops / 1e4,
+         busMicros(idle.stats, 400000) / idle.ops);
+  printf("(PCF8574/PCF8574A are specified up to 100 kHz; Wire library time between bytes is not included)\n");
+}
+
+static void ledCommand(uint8_t ledNo, bool on)
+{
+  char topic[32];
+  snprintf(topic, sizeof(topic), "arduino01/led/set/%u", ledNo);
+  shimMqttInject(topic, on ? "{\"state\":\"on\"}" : "{\"state\":\"off\"}");
+}
+
+// Button 7 drives led 32, button 37 drives leds 34, 61 and 62, buttons 3 and 120 switch everything off
+static void pressSingle(uint32_t) { onSwitchPressed(7, false); }
+static void pressMulti(uint32_t) { onSwitchPressed(37, false); }
+static void holdSingle(uint32_t) { onSwitchPressed(7, true); }
+static void mqttLed(uint32_t n) { ledCommand(160 + 32, n & 1); }
+static void mqttButton(uint32_t) { shimMqttInject("arduino01/button/set/37", "{\"state\":\"pressed\"}"); }
+static void mqttUnknownLed(uint32_t) { ledCommand(160 + 78, true); }
+static void pressBurst(uint32_t)
+{
+  for (uint8_t i = 0; i < 10; i++) onSwitchPressed(37, false);
+}
+static void allOff(uint32_t) { onSwitchPressed(3, false); }
+static void allOn(uint32_t) { shimMqttInject("arduino01/led/set/all", "{\"state\":\"on\"}"); }
+static void mqttAllOff(uint32_t) { shimMqttInject("arduino01/led/set/all", "{\"state\":\"off\"}"); }
+// led 193 ("Schody") switches itself off after 300 s; button 33 drives it and delays the off by 60 s when held
+static void stairsOn(uint32_t) { ledCommand(160 + 33, true); }
+static void stairsHold(uint32_t)
+{
+  onSwitchPressed(33, false);
+  onSwitchPressed(33, true);
+}
+
+// Button 80 (0x38 P0) drives led 160 (0x20 P0); pressed for 100 ms with 3 ms of contact bounce
+static void expanderPress(uint32_t)
+{
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    shimI2cSetInputLow(0x38, 0x01);
+    runFor(1);
+    shimI2cSetInputLow(0x38, 0x00);
+  }
+  shimI2cSetInputLow(0x38, 0x01);
+  runFor(100);
+  shimI2cSetInputLow(0x38, 0x00);
+}
+
+// virtual ms from the contact closing to the output expander being written
+static double pressToLight(uint8_t inputAddress, uint8_t inputMask, uint8_t outputAddress, uint32_t iterations)
+{
+  double total = 0;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint8_t latch = shimI2cLatch(outputAddress);
+    uint64_t t0 = shimNowMicros();
+    shimI2cSetInputLow(inputAddress, inputMask);
+    for (uint32_t ms = 0; ms < 1000 && shimI2cLatch(outputAddress) == latch; ms++) runFor(1);
+    total += (shimNowMicros() - t0) / 1000.0;
+    runFor(100);
+    shimI2cSetInputLow(inputAddress, 0);
+    runFor(settleMs);
+  }
+  return total / (iterations ? iterations : 1);
+}
+
+// the same for a button on an Arduino pin (button 7 drives led 192, 0x23 P2)
+static double pinPressToLight(uint8_t pin, uint8_t outputAddress, uint32_t iterations)
+{
+  double total = 0;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint8_t latch = shimI2cLatch(outputAddress);
+    uint64_t t0 = shimNowMicros();
+    shimSetPin(pin, LOW);
+    for (uint32_t ms = 0; ms < 1000 && shimI2cLatch(outputAddress) == latch; ms++) runFor(1);
+    total += (shimNowMicros() - t0) / 1000.0;
+    runFor(100);
+    shimSetPin(pin, HIGH);
+    runFor(settleMs);
+  }
+  return total / (iterations ? iterations : 1);
+}
+
+// The broker accepts TCP but never answers CONNECT: every attempt waits for CONNACK until mqttConnackTimeoutMs.
+// Button 7 is pressed over and over for 120 s while the connection manager keeps trying; worst virtual ms from the
+// contact closing to the light, and the number of presses.
+static double pinPressWhileConnecting(uint8_t pin, uint8_t outputAddress, uint32_t* presses)
+{
+  shimBrokerUp = false;
+  runFor(200);
+  shimBrokerUp = true;
+  shimBrokerHalfOpen = true;
+  double worst = 0;
+  *presses = 0;
+  for (uint64_t end = shimNowMicros() + 120000000ULL; shimNowMicros() < end; (*presses)++)
+  {
+    uint8_t latch = shimI2cLatch(outputAddress);
+    uint64_t t0 = shimNowMicros();
+    shimSetPin(pin, LOW);
+    for (uint32_t ms = 0; ms < 5000 && shimI2cLatch(outputAddress) == latch; ms++) runFor(1);
+    double ms = (shimNowMicros() - t0) / 1000.0;
+    if (ms > worst) worst = ms;
+    runFor(50);
+    shimSetPin(pin, HIGH);
+    runFor(30 + *presses % 7);  // spreads the presses over the attempts
+  }
+  shimBrokerHalfOpen = false;
+  runFor(2 * settleMs);
+  return worst;
+}
+
+// The broker answers the TCP SYN only after synAckMs (Wi-Fi, a busy host): virtual s from the broker coming back
+// to MQTT connected, 0 if it did not connect within 5 minutes.
+static double connectSlowBroker(uint16_t synAckMs)
+{
+  for (uint32_t ms = 0; !mqttConnected && ms < 120000; ms += 10) runFor(10); // the backoff of an earlier scenario
+  shimBrokerUp = false;
+  runFor(200);
+  shimBrokerSynAckMs = synAckMs;
+  shimBrokerUp = true;
+  uint64_t t0 = shimNowMicros();
+  while (!mqttConnected && shimNowMicros() - t0 < 300000000ULL) runFor(10);
+  double s = mqttConnected ? (shimNowMicros() - t0) / 1e6 : 0;
+  shimBrokerSynAckMs = 0;
+  runFor(2 * settleMs);
+  return s;
+}
+
+// Button 34 (Salon 1, leds 196 and 210) has a double click action (the whole salon): its clicks are counted.
+// Virtual ms from the first contact closing to the output expander being written, for clicks of 80 ms with 80 ms
+// between; the output is looked at once the last click is over.
+static double pinClicksToLight(uint8_t pin, uint8_t clicks, uint8_t outputAddress, uint32_t iterations)
+{
+  double total = 0;
+  for (uint32_t n = 0; n < iterations; n++)
+  {
+    uint8_t latch = shimI2cLatch(outputAddress);
+    uint64_t t0 = shimNowMicros();
+    for (uint8_t c = 0; c < clicks; c++)
+    {
+      if (c) runFor(80);
+      shimSetPin(pin, LOW);
+      for (uint32_t ms = 0; ms < 80; ms++) runFor(1);
+      shimSetPin(pin, HIGH);
+    }
+    for (uint32_t ms = 0; ms < 1000 && shimI2cLatch(outputAddress) == latch; ms++) runFor(1);
+    total += (shimNowMicros() - t0) / 1000.0;
+    runFor(settleMs);
+  }
+  return total / (iterations ? iterations : 1);
+}
+
+static void mqttDoubleClick(uint32_t) { shimMqttInject("arduino01/button/set/34", "{\"state\":\"double_click\"}"); }
+static void pinDoubleClick(uint32_t) { pinClicksToLight(34, 2, 0x23, 1); }
+
+// Output expander 0x20 (leds 160..167) stops answering; button 8 drives led 165 on it, button 7 led 192 on 0x23
+static void expanderGone(uint32_t)
+{
+  shimI2cRemoveDevice(0x20);
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    onSwitchPressed(8, false);
+    onSwitchPressed(7, false);
+    runFor(100);
+  }
+}
+static void expanderBack(uint32_t) { shimI2cAddDevice(0x20); }
+// a slave holds SDA low until SCL has been clocked 3 times
+static void sdaStuck(uint32_t)
+{
+  shimI2cHoldSda(3);
+  onSwitchPressed(7, false);
+}
+
+static void brokerDown(uint32_t) { shimBrokerUp = false; }
+static void brokerUp(uint32_t) { shimBrokerUp = true; }
+// every led changes while the broker is down
+static void brokerDownAllOff(uint32_t)
+{
+  shimBrokerUp = false;
+  runFor(200);
+  allOff(0);
+}
+// the socket write of the first batch fails: its states must go out again after the reconnect
+static void allOffWriteFails(uint32_t)
+{
+  shimNetFailWrites = 1;
+  allOff(0);
+}
+static void haOnline(uint32_t) { shimMqttInject("homeassistant/status", "online"); }
+
+int main(int argc, char** argv)
+{
+  uint32_t iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+
+  for (size_t i = 0; i < sizeof(outputExpanders); i++) shimI2cAddDevice(outputExpanders[i]);
+  for (size_t i = 0; i < sizeof(inputExpanders); i++)
+  {
+    shimI2cAddDevice(inputExpanders[i]);
+    #ifdef inputExpanderIntPin
+      shimI2cSetIntPin(inputExpanders[i], inputExpanderIntPin);
+    #endif
+  }
+
+  printHeader();
+
+  shimResetStats();
+  Result boot = {"boot (setup)", 1, 0, 0, {}};
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  setup();
+  boot.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  boot.stats = shimStats;
+  printResult(boot);
+
+  // MQTT connects and sends discovery in the background after setup
+  ShimStats before = shimStats;
+  runFor(2 * settleMs);
+  Result firstConnect = {"first connect, 30 s", 1, 0, 0, {}};
+  addStats(firstConnect.stats, shimStats, before, nullptr);
+
+  before = shimStats;
+  runFor(settleMs);
+  memset(&idleStats, 0, sizeof(idleStats));
+  addStats(idleStats, shimStats, before, nullptr);
+  Result idle = {"idle (per second)", settleMs / 1000, 0, 0, idleStats};
+  printResult(idle);
+  ShimStats noStats = {};
+  addStats(firstConnect.stats, noStats, idleStats, nullptr);
+  addStats(firstConnect.stats, noStats, idleStats, nullptr);
+  printResult(firstConnect);
+  printf("%-28s lights %lu, buttons %lu, network %lu, mqtt %lu\n", "boot stages (virtual us)",
+         (unsigned long)bootStageUs[bootLights], (unsigned long)bootStageUs[bootButtons],
+         (unsigned long)bootStageUs[bootNetwork], (unsigned long)bootStageUs[bootMqtt]);
+  printf("%-28s %u scheduled, %u slots (DEFAULT_TASK_SIZE)\n", "taskManager tasks", shimTasksScheduled(), DEFAULT_TASK_SIZE);
+  if (shimTasksRefused)
+  {
+    printf("FAIL: %u tasks did not get a taskManager slot\n", shimTasksRefused);
+    return 1;
+  }
+
+  printResult(measure("button press, 1 led", iterations, nullptr, pressSingle));
+  printResult(measure("button press, 3 leds", iterations, nullptr, pressMulti));
+  printResult(measure("button held, 1 led", iterations, nullptr, holdSingle));
+  printResult(measure("mqtt led command", iterations, nullptr, mqttLed));
+  printResult(measure("mqtt button command", iterations, nullptr, mqttButton));
+  printResult(measure("mqtt command, unknown led", iterations, nullptr, mqttUnknownLed));
+  printResult(measure("10 presses in a row", iterations, nullptr, pressBurst));
+  printResult(measure("expander button, bouncing", iterations, nullptr, expanderPress));
+  printResult(measure("double click, 8 leds", iterations, nullptr, pinDoubleClick));
+  printResult(measure("mqtt double click command", iterations, nullptr, mqttDoubleClick));
+  printResult(measure("all off (from all on)", iterations, allOn, allOff));
+  printResult(measure("mqtt all off (from all on)", iterations, allOn, mqttAllOff));
+  printResult(window("auto-off after 300 s", 301000, stairsOn));
+  printResult(window("hold, delayed off, 61 s", 61000, stairsHold));
+  printResult(window("expander 0x20 gone, 60 s", 60000, expanderGone));
+  printResult(window("expander 0x20 back, 31 s", 31000, expanderBack));
+  printf("%-28s %s\n", "expander 0x20 port", shimI2cLatch(0x20) == ledPorts[0] ? "rewritten" : "NOT rewritten");
+  printResult(measure("press, stuck SDA recovered", iterations, nullptr, sdaStuck));
+  printResult(window("broker down for 60 s", 60000, brokerDown));
+  printResult(measure("button press, broker down", iterations, nullptr, pressSingle));
+  printResult(window("broker back, 60 s", 60000, brokerUp));
+  allOn(0);
+  runFor(settleMs);
+  printResult(window("broker down, all off, 60 s", 60000, brokerDownAllOff));
+  printResult(window("broker back, 57 leds changed", 60000, brokerUp));
+  allOn(0);
+  runFor(settleMs);
+  printResult(window("all off, socket write fails", 60000, allOffWriteFails));
+  printResult(window("home assistant restart, 10 s", 10000, haOnline));
+
+  printf("\npress to light (virtual ms): expander button %.1f, Arduino pin button %.1f\n",
+         pressToLight(0x38, 0x01, 0x20, iterations), pinPressToLight(7, 0x23, iterations));
+  uint32_t presses;
+  double connecting = pinPressWhileConnecting(7, 0x23, &presses);
+  printf("press to light while connecting to a broker that does not answer (virtual ms): worst %.1f of %lu presses\n",
+         connecting, (unsigned long)presses);
+  double slow50 = connectSlowBroker(50), slow300 = connectSlowBroker(300);
+  printf("broker answering TCP after 50 / 300 ms, connected after (virtual s): %.1f / %.1f\n", slow50, slow300);
+  if (!slow50 || !slow300)
+  {
+    printf("FAIL: a slow broker was never connected\n");
+    return 1;
+  }
+  printf("click to light (virtual ms), button with a double click action: single %.1f, double %.1f\n",
+         pinClicksToLight(34, 1, 0x23, iterations), pinClicksToLight(34, 2, 0x23, iterations));
+
+  // the anti-entropy sweep: every round ends with the whole house message
+  uint16_t seq = publishStateAllSeq;
+  runFor((uint32_t)publishSweepMs * noOfLedBits + settleMs);
+  printf("sweep round (%lu s): whole house message sent %u times\n",
+         (unsigned long)publishSweepMs * noOfLedBits / 1000, (uint16_t)(publishStateAllSeq - seq));
+  if (publishStateAllSeq == seq)
+  {
+    printf("FAIL: the sweep did not send the whole house message\n");
+    return 1;
+  }
+
+  // what the sketch measured itself over the whole run (virtual µs: only waits between loop passes show up)
+  char latency[mqttMessageMax];
+  if (latencyRender(latency, sizeof(latency))) printf("latency [count,min,p99,max] us: %s\n", latency);
+  char health[mqttMessageMax];
+  if (i2cHealthRender(health, sizeof(health))) printf("i2c [transactions,failed,max_us,quarantined]: %s\n", health);
+  char counters[mqttMessageMax];
+  if (diagCountersRender(counters, sizeof(counters))) printf("counters: %s\n", counters);
+  printf("mqtt bursts: %lu packets in %lu socket writes, %.0f bytes per write\n", (unsigned long)mqttSocket.packets,
+         (unsigned long)mqttSocket.segments, mqttSocket.segments ? (double)mqttSocket.bytes / mqttSocket.segments : 0.0);
+  printI2cReport();
+  printf("watchdog overruns (loop blocked longer than the watchdog timeout): %u\n", shimWatchdogOverruns);
+  return 0;
+}
+#endif
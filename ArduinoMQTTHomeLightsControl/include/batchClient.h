@@ -0,0 +1,76 @@
+/*
+Socket writes batched under PubSubClient.
+
+PubSubClient writes every packet with its own write() and on the W5100 each write is its own SEND: one SPI
+transaction set and one TCP segment per message. BatchClient sits between mqttClient and ethClient and copies
+the packets into a batchSize buffer instead; the buffer goes to the socket as one write when the next packet
+would not fit, before anything is read from the socket (PubSubClient waits for CONNACK after CONNECT), on
+stop(), and from loop() through poll() - so the messages of one event leave together as one segment.
+A packet larger than the buffer is written through after the pending ones.
+
+write() only copies, so its success says nothing about the socket. A batch that then fails to go out is latched:
+until the next connect() write() fails and connected() is false, so PubSubClient and mqttConnection see a dead
+connection. Senders that must not lose a message (the publish queue, discovery, the boot report) call push() after
+their publishes: it sends at once and tells whether everything since the connect reached the socket; if not they
+keep the messages to send again after the reconnect.
+
+poll() also reports bursts: when nothing was written for batchBurstGapMs the packets, segments and bytes since
+the first write of the burst are logged and added to the totals below.
+*/
+#ifndef BATCH_CLIENT_H
+#define BATCH_CLIENT_H
+
+#include "homeLights.h"
+#include <Client.h>
+
+#define batchSize 256          // the Mega has no RAM for a full 1460 byte segment
+#define batchBurstGapMs 100
+
+class BatchClient : public Client
+{
+  public:
+    BatchClient(Client& socket) : socket(socket) {}
+
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    int available() { send(); return socket.available(); }
+    int read() { send(); return socket.read(); }
+    int read(uint8_t* buf, size_t size) { send(); return socket.read(buf, size); }
+    int peek() { send(); return socket.peek(); }
+    void flush() { send(); }
+    void stop();
+    uint8_t connected() { return !lost && socket.connected(); }
+    operator bool() { return socket; }
+
+    // from loop(): send what the last event queued, close a burst after a pause
+    void poll();
+
+    // send what is pending now; false if it, or a batch before it since the last connect, did not reach the socket
+    bool push() { return send() && !lost; }
+
+    // mqttConnection sent CONNECT itself: the one PubSubClient::connect() writes next is not sent again
+    void dropConnect() { connectSent = true; }
+
+    // totals of the bursts so far
+    uint32_t packets = 0;
+    uint32_t segments = 0;
+    uint32_t bytes = 0;
+
+  private:
+    bool send();
+    bool writeSegment(const uint8_t* buf, size_t size);
+
+    Client& socket;
+    uint8_t batch[batchSize];
+    uint16_t pending = 0;
+    bool connectSent = false;
+    bool lost = false;          // a batch failed to go out since the last connect
+    uint16_t burstPackets = 0;
+    uint16_t burstSegments = 0;
+    uint32_t burstBytes = 0;
+    unsigned long lastWrite = 0;
+};
+
+#endif
@@ -0,0 +1,32 @@
+/*
+Staged boot and its timing.
+
+setup() only does what the lights need: output states restored and written (bootLights), buttons scanned
+(bootButtons). The network comes up afterwards, from the first taskManager run: Ethernet.begin() blocks for
+the W5x00 reset (bootNetwork) and MQTT connects in the background (bootMqtt, the first connect), so a slow
+switch or broker never keeps the house dark or the buttons dead.
+
+Stage times are µs since the reset (micros(), the bootloader not counted; 0xFFFFFFFF after ~66 minutes).
+After the first MQTT connect they are published once, retained, to bootTopic:
+{"reset":<MCUSR>,"warm":0|1,"lights_us":..,"buttons_us":..,"network_us":..,"mqtt_us":..}
+*/
+#ifndef BOOT_STAGES_H
+#define BOOT_STAGES_H
+
+#include "homeLights.h"
+
+#define bootLights 0
+#define bootButtons 1
+#define bootNetwork 2
+#define bootMqtt 3
+#define bootStages 4
+
+extern uint32_t bootStageUs[bootStages];
+
+// stage reached (only the first call per stage counts)
+void bootStageDone(uint8_t stage);
+
+// publish the stage times, after the first connect only; warm as returned by warmRestartRestore()
+void bootReport(bool warm);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+Button gestures: single, double and triple click and long press, with per button actions.
+
+buttonInputs reports press, hold and release; this module turns them into gestures for onGesture():
+- a button without a double or triple click action reports a single click on the press, at once, as before -
+  no button pays the multi-click wait unless it has a multi-click action;
+- a button with one counts clicks and reports the gesture gestureClickGapMs after the last release, or on the
+  press that reaches its highest configured click count (a button with only a double click action switches on
+  the second press, not after the gap);
+- holding a button for inputHoldMs reports gestureLong. On a counting button it ends the count: the clicks
+  before the held press are reported first (click, click and hold: a single click, then gestureLong).
+  A button without multi-click actions has already reported the single click of that press.
+
+Actions are rows of a table in flash (gestureActions in main.cpp): button PIN, gesture, action, leds..., vL,
+with led numbers as in button2leds. A gesture without a row does what the button did before: a toggle per click,
+the hold behaviour of onSwitchPressed for a long press.
+*/
+#ifndef BUTTON_GESTURES_H
+#define BUTTON_GESTURES_H
+
+#include "homeLights.h"
+
+#define gestureSingle 0
+#define gestureDouble 1
+#define gestureTriple 2
+#define gestureLong 3
+
+// what a row does to its leds
+#define gestureToggle 0   // all on if all are off, otherwise all off
+#define gestureOn 1
+#define gestureOff 2
+
+#define gestureClickGapMs 250
+#define gestureTickMs 10
+#define gestureSlots 4    // buttons counting clicks at the same time
+
+void gesturesBegin(const uint8_t* table, size_t tableSize, void (*onGesture)(uint8_t key, uint8_t gesture));
+
+// buttonInputs events
+void gesturesInput(uint8_t key, uint8_t event);
+
+// Row of gesture on key: *action is set and the leds (in flash, ending with vL) returned; nullptr without a row
+const uint8_t* gestureAction(uint8_t key, uint8_t gesture, uint8_t* action);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+Button inputs: Arduino pins and the PCF8574A input expanders.
+
+Arduino pins are read a whole AVR port (PINA, PINC, PINK...) at a time every inputTickMs: with the buttons of
+button2leds that is a handful of register reads per tick, whatever the number of buttons.
+
+Each expander is read on its own, only when there is a reason to: its INT line (open drain, several expanders
+may share one Mega pin) went LOW, it is still debouncing, or - for expanders without an INT line - every
+inputPollMs as before. Expanders with an INT line are also read every inputSafetyPollMs in case a change was missed.
+An INT pin with an external interrupt (Mega pins 2, 3, 18, 19, 20, 21) also latches short pulses in an ISR;
+on other pins the level is checked every tick. Reading is always done from the task, never from the ISR,
+through i2cBus: a failed read is skipped (the expander stays due), a quarantined expander is not read at all.
+
+The 8 inputs of a port or an expander are debounced together with vertical counters, the same way for every PIN: a bit changes after inputDebounceSamples
+equal samples, inputTickMs apart. A press calls onEvent(key, inputPressed), holding it for inputHoldMs calls
+onEvent(key, inputHeld) once - the events switches (IoAbstraction) delivered - and letting go calls
+onEvent(key, inputReleased) (buttonGestures counts clicks with it). Only PINs present in button2leds
+(buttonConfigured) report events.
+*/
+#ifndef BUTTON_INPUTS_H
+#define BUTTON_INPUTS_H
+
+#include "homeLights.h"
+
+#define inputTickMs 5
+#define inputDebounceSamples 4    // fixed by the 2 bit vertical counter
+#define inputHoldMs 400           // HOLD_THRESHOLD (20) x 20 ms of IoAbstraction switches
+#define inputPollMs 20
+#define inputSafetyPollMs 1000
+#define maxInputExpanders 8
+#define maxInputPorts 11          // PA..PL
+#define inputHoldSlots 8          // buttons held at the same time that can still report "held"
+#define noIntPin 0xFF
+
+#define inputPressed 0
+#define inputHeld 1
+#define inputReleased 2
+
+// Arduino pin (pulled up, the button pulls it LOW); the button PIN number is the pin number
+void buttonInputsAddPin(uint8_t pin);
+
+// PCF8574A at address; its P0..P7 are buttons firstKey..firstKey+7
+void buttonInputsAddExpander(uint8_t address, uint8_t firstKey, uint8_t intPin = noIntPin);
+
+void buttonInputsBegin(void (*onEvent)(uint8_t key, uint8_t event));
+
+#endif
@@ -0,0 +1,25 @@
+/*
+RAM index of button2leds, built once at boot.
+
+For every button PIN below startLedNo it keeps the leds it switches, as ledPorts bit numbers, in a
+slice of one packed array (CSR layout: leds of button k are buttonLedList[buttonLedStart[k] .. buttonLedStart[k+1])).
+Led numbers that are not an output are dropped.
+Looking up a button is two array reads, no matter where it is in the table or how many leds it has.
+*/
+#ifndef BUTTON_MAP_H
+#define BUTTON_MAP_H
+
+#include "homeLights.h"
+
+extern uint8_t noOfButtons;
+
+// table is button2leds in flash: button PIN, its leds, vL, next button PIN, ...
+void buttonMapBuild(const uint8_t* table, size_t tableSize);
+
+// true if the PIN has a row in button2leds
+bool buttonConfigured(uint8_t key);
+
+// number of leds switched by the button; *leds points to their bits in ledPorts (see ledStates.h)
+uint8_t buttonLeds(uint8_t key, const uint8_t** leds);
+
+#endif
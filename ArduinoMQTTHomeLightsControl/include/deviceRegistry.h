@@ -0,0 +1,47 @@
+/*
+Registry of the leds and buttons defined in main.cpp (leds[], buttons[]), kept in flash.
+
+Both tables are const PROGMEM, so names and settings take no SRAM: single fields are read with pgm_read_byte,
+a whole entry is copied into the caller's variable only while a Home Assistant config is rendered.
+What changes at run time lives elsewhere in RAM: led states and the enabled outputs in ledStates,
+button states in buttonInputs.
+*/
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include "homeLights.h"
+
+#define ledNameMax 14
+#define buttonNameMax 20
+
+struct LedEntry
+{
+  uint8_t ledNo;
+  uint8_t ledInitState;       // ON/OFF used when no stored state is found
+  uint8_t ledAutoDiscovery;   // 1: visible in Home Assistant
+  char ledName[ledNameMax];
+  uint16_t ledAutoOffS;       // switch off after this many seconds on, 0 = never (ledTimers.h)
+};
+
+struct ButtonEntry
+{
+  uint8_t buttonNo;
+  uint8_t buttonAutoDiscovery;
+  char buttonName[buttonNameMax];
+};
+
+// leds and buttons are tables in flash
+void registryBegin(const LedEntry* leds, uint8_t noOfLeds, const ButtonEntry* buttons, uint8_t noOfButtons);
+
+extern uint8_t registryLeds;
+extern uint8_t registryButtons;
+
+uint8_t registryLedNo(uint8_t i);
+uint8_t registryLedInitState(uint8_t i);
+uint16_t registryLedAutoOff(uint8_t i);
+
+// copy entry i into RAM
+void registryLed(uint8_t i, LedEntry& led);
+void registryButton(uint8_t i, ButtonEntry& button);
+
+#endif
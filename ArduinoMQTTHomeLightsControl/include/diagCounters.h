@@ -0,0 +1,28 @@
+/*
+Event counters of the background modules, in one diagnostic message.
+
+The modules keep their own counters (publishQueue.h ...); this only reads them. The message goes to
+countersTopic every diagReportMs, and with the latency histograms after any message on latencyGetTopic:
+
+  {"publish":[sent,dropped,failed,depth]}
+
+  publish    messages handed to the socket, button events lost to a full FIFO, ticks whose messages did not
+             reach the socket, messages waiting (publishQueue)
+*/
+#ifndef DIAG_COUNTERS_H
+#define DIAG_COUNTERS_H
+
+#include "homeLights.h"
+
+#define diagReportMs 60000UL    // 0: only on request
+#define diagTickMs 1000
+
+void diagCountersBegin();
+
+// publish the counters at the next tick
+void diagCountersRequestReport();
+
+// the counters payload, returns its length (0 if it does not fit)
+size_t diagCountersRender(char* payload, size_t size);
+
+#endif
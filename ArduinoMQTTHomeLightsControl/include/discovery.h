@@ -0,0 +1,33 @@
+/*
+Home Assistant MQTT discovery, paced and incremental.
+
+Configs are sent by a taskManager task, at most discoveryPerTick every discoveryTickMs, after the lights are restored,
+so neither boot nor switching waits for them. A 16 bit hash of every config (topic + payload) that reached the broker
+is kept in EEPROM (eepromDiscoveryStart, one slot per button PIN and per led bit, written in the background by the
+state journal writer); a config whose hash matches is not sent again. A normal reboot therefore only renders the
+configs and sends nothing.
+When Home Assistant announces itself (haStatusTopic "online") all configs are sent again, as the broker may have lost them.
+A config is rendered into static buffers, the payload into mqttMessage (mqttEncoder), not on the stack.
+*/
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include "homeLights.h"
+#include "mqttEncoder.h"
+
+#define discoveryTickMs 50
+#define discoveryPerTick 2       // configs published per tick
+#define discoveryChecksPerTick 8 // configs rendered and compared per tick
+#define discoveryTopicMax 48
+#define discoveryPayloadMax mqttMessageMax
+
+// Render config no entity (0 .. noOfEntities-1) into topic and payload (an empty payload removes the entity).
+// Returns the payload length; key is the button or led PIN the config belongs to.
+typedef uint16_t (*DiscoveryRender)(uint16_t entity, uint8_t* key, char* topic, char* payload);
+
+void discoveryBegin(uint16_t noOfEntities, DiscoveryRender render);
+
+// go through all configs again (after a connect); force sends them even if unchanged
+void discoveryRestart(bool force);
+
+#endif
@@ -0,0 +1,57 @@
+/*
+Definitions shared by the sketch (main.cpp) and its modules.
+*/
+#ifndef HOME_LIGHTS_H
+#define HOME_LIGHTS_H
+
+#include <Arduino.h>
+
+//define ON/OFF for low triggered output PINs
+#define ON 0
+#define OFF 1
+
+// no of PINS reserved for Arduino; first expander's PIN will start from EXPANDER1 value
+#define ArduinoPins 80
+#define startLedNo 160
+
+// vL - voidLed - number representing no led assigned; ends the list of leds of a button in button2leds
+#define vL 255
+
+// EEPROM layout (ATmega2560: 4096 bytes). 0..63 is the old one byte per led area, kept to migrate from it.
+#define eepromLegacyStart 0
+#define eepromJournalStart 64
+#define eepromJournalSize 3584
+// 16 bit hashes of the sent Home Assistant discovery configs (discovery.h)
+#define eepromDiscoveryStart 3648
+#define eepromDiscoverySize 448
+
+// max number of button -> led links in button2leds (sum of leds of all buttons), max 255
+#define maxButtonLedLinks 160
+
+#define buttonSetTopic "arduino01/button/set"
+#define buttonStateTopic "arduino01/button/state"
+#define ledSetTopic "arduino01/led/set"
+#define ledStateTopic "arduino01/led/state"
+// all leds in one retained message: {"seq":<n>,"on":"<16 hex digits>"}, byte e (expander 0x20+e) first, bit b = led startLedNo+10*e+b, 1 = on
+#define ledStateAllTopic "arduino01/led/state_all"
+// ledSetTopic/all switches many leds at once: {"state":"off"} for all, {"state":"on","mask":"<16 hex digits>"} for some
+#define ledSetAllSuffix "all"
+// ledTimerTopic/<led> sets the auto-off time of a led: {"off_after":<seconds, 0 = never>} or {"off_after":"default"}
+// (retained, it is applied again after every reconnect), or switches it off once: {"off_in":<seconds>}
+#define ledTimerTopic "arduino01/led/timer"
+// Home Assistant birth message ("online"), discovery configs are sent again after it
+#define haStatusTopic "homeassistant/status"
+// latency histograms (latencyStats.h), sent periodically and after any message on latencyGetTopic
+#define latencyTopic "arduino01/diag/latency"
+#define latencyGetTopic "arduino01/diag/latency/get"
+// boot stage times (bootStages.h), retained, once per boot
+#define bootTopic "arduino01/diag/boot"
+// expander health (i2cBus.h), sent periodically and when an expander is quarantined or answers again
+#define i2cHealthTopic "arduino01/diag/i2c"
+// event counters (diagCounters.h), sent periodically and with the latency histograms
+#define countersTopic "arduino01/diag/counters"
+
+void onSwitchPressed(uint8_t key, bool held);
+void onGesture(uint8_t key, uint8_t gesture);
+
+#endif
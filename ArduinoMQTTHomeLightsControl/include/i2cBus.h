@@ -0,0 +1,49 @@
+/*
+I2C transactions with the PCF8574(A) expanders, bounded in time, retried and counted per expander.
+
+- Wire runs with a timeout (i2cTimeoutUs, Wire.setWireTimeout of the AVR core): a chip or a cable holding SDA
+  or SCL low makes the transaction fail instead of hanging loop().
+- A failed transaction is tried again up to i2cRetries times. After a timeout the bus is recovered first: TWI
+  off, SCL clocked (up to 9 pulses) until the slave lets SDA go, a STOP, TWI on again.
+- Per expander: transactions, failed ones, the longest one (µs) and failures in a row. After
+  i2cQuarantineErrors failed transactions in a row an expander is quarantined: skipped without touching the
+  bus for i2cQuarantineMs, then tried once (no retries) - a failure quarantines it again. One dead chip costs
+  the others nothing but its first few failed transactions.
+- Health goes to i2cHealthTopic every i2cReportMs and when an expander enters or leaves quarantine:
+  {"recoveries":n,"20":[transactions,failed,max_us,quarantined],...} keyed by the hex address.
+Expanders are added at their first transaction.
+*/
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include "homeLights.h"
+
+#define i2cTimeoutUs 3000
+#define i2cRetries 2
+#define i2cQuarantineErrors 5
+#define i2cQuarantineMs 30000UL
+#define i2cReportMs 60000UL    // 0: only on quarantine changes
+#define i2cTickMs 1000
+#define i2cMaxDevices 12
+
+// Mega TWI pins
+#define i2cSdaPin 20
+#define i2cSclPin 21
+
+// Wire.begin() with the timeout, in setup() before any transaction
+void i2cBusBegin();
+
+// health publishing, once MQTT is set up
+void i2cHealthBegin();
+
+// one byte to / from the expander at address; false if it failed (after the retries) or is quarantined
+bool i2cWrite(uint8_t address, uint8_t value);
+bool i2cRead(uint8_t address, uint8_t* value);
+
+// the health payload, returns its length (0 if it does not fit)
+size_t i2cHealthRender(char* payload, size_t size);
+
+// bus recoveries since boot
+extern uint16_t i2cRecoveries;
+
+#endif
@@ -0,0 +1,55 @@
+/*
+Latency histograms of the switching pipeline, in µs (micros()).
+
+Every stage has latencyBuckets log2 buckets (bucket i: below 2^i µs, the last one open ended) and the exact
+min and max, so the p99 estimate is good to a factor of 2 and recording costs a few shifts and an increment.
+A bucket about to overflow halves all buckets of its stage, which keeps the shape of the distribution.
+
+  detect         first read that saw a contact change -> debounced press (buttonInputs)
+  dispatch       event start (press reported, MQTT message received) -> output expanders about to be written
+  output         ledStatesFlush(): the I2C writes to the output expanders
+  persist        one journal byte written to EEPROM (stateJournal)
+  publish        state message queued -> handed to the socket, from the time the queue stopped being empty
+  press_to_light first read that saw a contact change -> output expanders written
+  mqtt_to_light  MQTT command received (callback) -> output expanders written
+
+The histograms are published to latencyTopic as {"<stage>":[count,min,p99,max],...} (stages with samples only)
+every latencyReportMs and after any message on latencyGetTopic; a "reset" message clears them once sent.
+*/
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include "homeLights.h"
+
+#define latencyBuckets 20           // the last one: 2^18 µs (262 ms) and more
+#define latencyReportMs 60000UL     // 0: only on request
+#define latencyTickMs 1000
+
+#define latencyDetect 0
+#define latencyDispatch 1
+#define latencyOutput 2
+#define latencyPersist 3
+#define latencyPublish 4
+#define latencyPressToLight 5
+#define latencyMqttToLight 6
+#define latencyStages 7
+
+void latencyBegin();
+
+void latencyRecord(uint8_t stage, uint32_t us);
+
+// An event that may switch leds starts (origin: when it began, endToEnd: latencyPressToLight or
+// latencyMqttToLight) / is over. In between, latencyLedsWritten() records dispatch and the end to end time once.
+void latencyEventBegin(uint8_t endToEnd, uint32_t origin);
+void latencyEventEnd();
+
+// the output expanders were written, the flush started at flushAt
+void latencyLedsWritten(uint32_t flushAt);
+
+// publish the histograms at the next tick; reset clears them after that
+void latencyRequestReport(bool reset);
+
+// the report payload, returns its length (0 if it does not fit)
+size_t latencyRender(char* payload, size_t size);
+
+#endif
@@ -0,0 +1,69 @@
+/*
+Authoritative state of all outputs ("leds"), one bit per output.
+
+Output expander e (PCF8574 at outputExpanderAddress + e) drives leds startLedNo + 10*e .. startLedNo + 10*e + 7,
+so the state of led startLedNo + 10*e + b is bit b of ledPorts[e]. Bits keep the PIN level: ON (0) or OFF (1).
+
+Changes made while handling one event (button, MQTT command, all off) only touch the bitmap.
+ledStatesFlush() then sends the new port byte of every expander that changed - one 2 byte I2C write
+per expander - so leds on the same expander switch together. An expander whose write failed keeps its new
+state in ledPorts and is written again by ledStatesRetry().
+*/
+#ifndef LED_STATES_H
+#define LED_STATES_H
+
+#include "homeLights.h"
+
+// 8 x PCF8574 (0x20..0x27) = 64 outputs
+#define outputExpanderAddress 0x20
+#define noOfOutputExpanders 8
+#define noOfLedBits (noOfOutputExpanders * 8)
+#define noLedBit 0xFF
+
+extern uint8_t ledPorts[noOfOutputExpanders];
+
+// mask with every output, for ledSetMask()
+extern const uint8_t ledAllMask[noOfOutputExpanders];
+
+// led PIN number -> bit index 0..63, noLedBit if the number is not an output
+inline uint8_t ledBit(uint8_t ledNo)
+{
+  if (ledNo < startLedNo) return noLedBit;
+  uint8_t n = ledNo - startLedNo;
+  uint8_t expander = n / 10;
+  uint8_t pin = n - expander * 10;
+  if (expander >= noOfOutputExpanders || pin > 7) return noLedBit;
+  return expander * 8 + pin;
+}
+
+inline uint8_t ledBitToNo(uint8_t bit)
+{
+  return startLedNo + (bit >> 3) * 10 + (bit & 7);
+}
+
+inline uint8_t ledGet(uint8_t bit)
+{
+  return (ledPorts[bit >> 3] >> (bit & 7)) & 1;
+}
+
+// declare an output as used (a row in leds[]); other bits are never changed nor written
+void ledEnable(uint8_t bit);
+bool ledEnabled(uint8_t bit);
+
+void ledSet(uint8_t bit, uint8_t state);
+uint8_t ledToggle(uint8_t bit);
+
+// set every enabled led of mask (noOfOutputExpanders bytes laid out like ledPorts) to state
+void ledSetMask(const uint8_t* mask, uint8_t state);
+
+// 16 hex digits, byte e (expander 0x20+e) first, into mask; false if malformed
+bool ledMaskParse(const char* hex, uint8_t* mask);
+
+// write the port byte of every expander with changed leds, once (i2cBus.h);
+// the leds that changed since the last flush are returned in changed (if not nullptr)
+void ledStatesFlush(uint8_t* changed = nullptr);
+
+// write again the expanders whose last write failed (quarantined ones are skipped until their time is up)
+void ledStatesRetry();
+
+#endif
@@ -0,0 +1,32 @@
+/*
+Local led timers: auto-off and delayed switching off, without the broker.
+
+Every led can have an auto-off time (ledAutoOffS in leds[], changed over MQTT on ledTimerTopic/<led>): when it
+turns on, its timer is armed; when it turns off, by hand or by the timer, it is cancelled. A timer can also be
+armed once (hold-to-delay-off buttons, "off_in" over MQTT) without changing the led's auto-off time.
+
+The timers are a hashed timer wheel of timerWheelSlots slots, one slot per second of the tick: a timer sits in
+the list of slot (expiry % timerWheelSlots), so a tick only walks one slot's list - the timers expiring now plus
+the few that expire a whole turn later - instead of all 64 leds. Arming and cancelling unlink from that one list.
+Expiry is a 16 bit second counter: at most 65535 s (18 h); a timer goes off 0..1 s early.
+*/
+#ifndef LED_TIMERS_H
+#define LED_TIMERS_H
+
+#include "homeLights.h"
+
+#define timerTickMs 1000
+#define timerWheelSlots 32       // power of 2
+
+// onExpired gets the leds whose timers ran out in this tick, laid out like ledPorts
+void ledTimersBegin(void (*onExpired)(const uint8_t* mask));
+
+// (re)arm the timer of led bit to go off in seconds; 0 cancels it
+void ledTimerStart(uint8_t bit, uint16_t seconds);
+bool ledTimerArmed(uint8_t bit);
+
+// auto-off time of led bit in seconds, 0 = never
+void ledAutoOffSet(uint8_t bit, uint16_t seconds);
+uint16_t ledAutoOff(uint8_t bit);
+
+#endif
@@ -0,0 +1,39 @@
+/*
+MQTT connection manager.
+
+Connecting is a small state machine run from taskManager every mqttConnectionTickMs, never a loop with delay().
+While the broker is unreachable one connect attempt is made per backoff period: the period doubles after every
+failure from mqttBackoffMin up to mqttBackoffMax and a random part (half of it) spreads retries of many devices.
+
+An attempt opens the TCP connection, sends CONNECT itself and returns; the following ticks poll the socket for
+CONNACK and give up after mqttConnackTimeoutMs (a half open broker). Only once CONNACK is there is
+PubSubClient::connect() called: the socket is connected, so it skips the TCP connect, its CONNECT is dropped by
+mqttSocket (already sent) and it reads the waiting CONNACK at once. The TCP connect is the one blocking call, the
+Ethernet library has no other: it is bounded by a connect timeout that starts at mqttConnectTimeoutMs and doubles
+after every failed TCP connect up to mqttConnectTimeoutMaxMs, so a broker that answers slowly (Wi-Fi, a busy host)
+is still reached while a LAN broker that is down costs little. Buttons keep working while connecting.
+
+After every successful connect the onConnected handler runs (subscribe, discovery; the publish queue sends what changed meanwhile), so a broker
+restart is picked up without resetting the Arduino. mqttConnected follows the connection state.
+*/
+#ifndef MQTT_CONNECTION_H
+#define MQTT_CONNECTION_H
+
+#include "homeLights.h"
+#include <IPAddress.h>
+
+#define mqttConnectionTickMs 100
+#define mqttBackoffMin 1000UL
+#define mqttBackoffMax 60000UL
+#define mqttConnectTimeoutMs 100
+#define mqttConnectTimeoutMaxMs 800
+#define mqttConnackTimeoutMs 3000
+#define mqttSocketTimeoutS 1    // PubSubClient's wait for the rest of a packet
+
+extern boolean mqttConnected;
+
+// first attempt on the next tick
+void mqttConnectionBegin(IPAddress broker, uint16_t port, const char* clientId, const char* user, const char* password,
+                         void (*onConnected)());
+
+#endif
@@ -0,0 +1,36 @@
+/*
+Allocation free outbound MQTT messages.
+
+Topics are built from PROGMEM prefixes and the PIN number into one static buffer, payloads are copied from
+a fixed set of pre-rendered PROGMEM strings into mqttMessage. A publish uses no heap, a few dozen bytes of stack and one
+PubSubClient::publish() (which copies topic and payload into its packet buffer and writes it with one socket write).
+*/
+#ifndef MQTT_ENCODER_H
+#define MQTT_ENCODER_H
+
+#include "homeLights.h"
+#include <PubSubClient.h>
+
+#define mqttTopicMax 48
+#define mqttMessageMax 512
+
+// The one payload buffer for outbound messages: the fixed payloads below, and the payloads tasks render in place
+// right before their publish (discovery configs, diagnostics), so none of them needs a big buffer on the stack.
+// Valid until the next publish of this module or the next render.
+extern char mqttMessage[mqttMessageMax];
+
+extern PubSubClient mqttClient;
+
+// prefix (PROGMEM) + "/" + number, in a static buffer valid until the next call
+const char* mqttTopicFor(const char* prefix, uint8_t number);
+
+// {"state":"on"} / {"state":"off"} (retained) to ledStateTopic/ledNo
+bool mqttPublishLedState(uint8_t ledNo, uint8_t ledState);
+
+// {"seq":seq,"on":"<hex>"} (retained) to ledStateAllTopic, ports laid out like ledPorts
+bool mqttPublishStateAll(uint16_t seq, const uint8_t* ports, uint8_t noOfPorts);
+
+// {"state":"pressed"}, "double_click", "triple_click" or "held_down" by gesture (retained) to buttonStateTopic/key
+bool mqttPublishButtonState(uint8_t key, uint8_t gesture);
+
+#endif
@@ -0,0 +1,44 @@
+/*
+Inbound MQTT commands.
+
+The sketch subscribes to three wildcards (ledSetTopic/+, ledTimerTopic/+ and buttonSetTopic/+) instead of one topic per PIN,
+plus haStatusTopic and latencyGetTopic.
+mqttRoute() parses the topic in place into a kind and a PIN number, drops PINs that are not configured
+(a bitmask test) and calls the handler registered for the kind. Nothing is copied, no String is built.
+Payload fields are read straight from the PubSubClient buffer with mqttPayloadValue().
+*/
+#ifndef MQTT_ROUTER_H
+#define MQTT_ROUTER_H
+
+#include "homeLights.h"
+
+enum MqttTopicKind
+{
+  topicUnknown,
+  topicButtonSet,   // buttonSetTopic/<button PIN>
+  topicLedSet,      // ledSetTopic/<led PIN>
+  topicLedSetAll,   // ledSetTopic/ledSetAllSuffix
+  topicLedTimer,    // ledTimerTopic/<led PIN>
+  topicHaStatus,    // haStatusTopic
+  topicLatencyGet,  // latencyGetTopic
+  noOfTopicKinds
+};
+
+typedef void (*MqttHandler)(uint8_t pin, const uint8_t* payload, unsigned int length);
+
+void mqttRouterOn(uint8_t kind, MqttHandler handler);
+
+// the subscriptions; call after every (re)connect
+bool mqttRouterSubscribe();
+
+// topic -> kind, *pin is set for topicButtonSet, topicLedSet and topicLedTimer. topicUnknown for foreign or not configured PINs.
+uint8_t mqttTopicKind(const char* topic, uint8_t* pin);
+
+// PubSubClient callback body: returns false if nothing handled the message
+bool mqttRoute(const char* topic, const uint8_t* payload, unsigned int length);
+
+// Copy the value of "key" from a flat JSON object ({"state":"on","mask":"..."}), quoted or not, into value.
+// Returns false if the key is missing or the value does not fit.
+bool mqttPayloadValue(const uint8_t* payload, unsigned int length, const char* key, char* value, uint8_t valueSize);
+
+#endif
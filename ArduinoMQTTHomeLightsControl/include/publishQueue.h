@@ -0,0 +1,59 @@
+/*
+Outbound MQTT queue.
+
+Switching code only marks what has to be sent; a taskManager task publishes at most publishPerTick messages
+every publishTickMs, so a slow socket never holds up the next relay switch or button scan.
+
+Led states are a pending bitmap laid out like ledPorts: the state is read when the message is sent, so any
+number of changes of one led while it waits collapse into one message with its latest state.
+With publishStateAll every batch of led changes also (or, without publishLedTopics, only) marks ledStateAllTopic:
+one message with all leds, sent after the led states of the batch. Changes made before it goes out join it,
+its seq grows by one per message so consumers can tell a missed update.
+Button events keep their order in a small FIFO; when it is full new events are dropped and counted.
+
+The pending bitmap is also the dirty set across disconnects: while MQTT is down led changes stay pending and
+of button events only the last one per button is kept (a bitmap and 2 bits per button), so after a reconnect
+only what changed is sent - recovery traffic follows what changed, not the size of the house. A button event is
+only sent if it is recent, at most publishMissedButtonMs to twice that old: an automation should not act on a
+press from long ago. With more than
+publishSnapshotAbove leds pending the whole house message goes first, one consistent snapshot at once; the per
+led states (the Home Assistant state topics) follow at the queue's pace, publishPerTick a tick. At boot every led
+is pending, the broker has not heard from this boot yet. A low rate sweep marks one more led every publishSweepMs
+(and the whole house message after each round), so a state lost anywhere - a broker restarted without persistence -
+heals by itself.
+*/
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include "homeLights.h"
+
+// per led topics (ledStateTopic/<led>, used by the Home Assistant discovery) and/or the whole house topic
+#define publishLedTopics 1
+#define publishStateAll 1
+
+#define publishTickMs 10
+#define publishPerTick 6      // 6 led states fill one batchClient buffer (one socket write)
+#define publishButtonQueueSize 16
+#define publishSnapshotAbove 8
+#define publishSweepMs 15000    // 0: no sweep; 15 s x 57 leds: every state once in ~15 min
+#define publishMissedButtonMs 5000    // button events missed while disconnected are dropped after 5..10 s
+
+extern uint32_t publishSent;      // messages handed to the socket
+extern uint16_t publishDropped;   // button events lost to a full FIFO
+extern uint16_t publishFailed;    // ticks whose messages did not all reach the socket (they are sent again)
+
+extern uint16_t publishStateAllSeq; // seq of the last ledStateAllTopic message
+
+void publishQueueBegin();
+
+// led state of bit (see ledStates.h)
+void publishLed(uint8_t bit);
+// led states of every enabled led in mask (noOfOutputExpanders bytes laid out like ledPorts)
+void publishLeds(const uint8_t* mask);
+// button event, gesture as in buttonGestures.h
+void publishButton(uint8_t key, uint8_t gesture);
+
+// messages waiting
+uint8_t publishQueueDepth();
+
+#endif
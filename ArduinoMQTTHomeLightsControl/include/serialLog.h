@@ -0,0 +1,63 @@
+/*
+Level filtered logging to Serial that never waits for the UART.
+
+logError/logWarn/logInfo/logDebug take a printf format (kept in flash) and its arguments; levels above
+logLevel are not compiled at all. A message is formatted into a 256 byte ring buffer and logDrain(), called
+from loop(), moves only as much as fits into the Serial TX buffer - at 9600 baud a character takes ~1 ms,
+so a line written straight to Serial would hold up switching. A message that does not fit in the ring is
+dropped and counted, the next one that fits is preceded by a "log messages dropped" line.
+%s arguments are RAM strings.
+*/
+#ifndef SERIAL_LOG_H
+#define SERIAL_LOG_H
+
+#include "homeLights.h"
+
+#define logLevelOff 0
+#define logLevelError 1
+#define logLevelWarn 2
+#define logLevelInfo 3
+#define logLevelDebug 4   // every button, led change and MQTT message
+
+// set with -DlogLevel=... in platformio.ini build_flags
+#ifndef logLevel
+#define logLevel logLevelDebug
+#endif
+
+// longest line, longer ones are cut
+#define logLineMax 80
+
+// format in PROGMEM
+void logWrite(const char* format, ...);
+
+// send buffered text while the Serial TX buffer has room
+void logDrain();
+
+// messages dropped because the ring buffer was full (since boot)
+extern uint16_t logDropped;
+
+#if logLevel >= logLevelError
+#define logError(format, ...) logWrite(PSTR(format "\r\n"), ##__VA_ARGS__)
+#else
+#define logError(format, ...) ((void)0)
+#endif
+
+#if logLevel >= logLevelWarn
+#define logWarn(format, ...) logWrite(PSTR(format "\r\n"), ##__VA_ARGS__)
+#else
+#define logWarn(format, ...) ((void)0)
+#endif
+
+#if logLevel >= logLevelInfo
+#define logInfo(format, ...) logWrite(PSTR(format "\r\n"), ##__VA_ARGS__)
+#else
+#define logInfo(format, ...) ((void)0)
+#endif
+
+#if logLevel >= logLevelDebug
+#define logDebug(format, ...) logWrite(PSTR(format "\r\n"), ##__VA_ARGS__)
+#else
+#define logDebug(format, ...) ((void)0)
+#endif
+
+#endif
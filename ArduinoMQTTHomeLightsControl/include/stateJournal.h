@@ -0,0 +1,45 @@
+/*
+Wear levelled, write-behind EEPROM journal of the led states.
+
+A record is the 8 ledPorts bytes plus a sequence number, flags and a CRC (12 bytes). Records are appended
+round robin over the journal area (eepromJournalStart, eepromJournalSize), so every cell is written once
+per ~300 commits. A commit happens journalQuietTime after the last change (at the latest journalMaxDelay
+after the first one) and is written one byte per tick, so it never blocks switching for the EEPROM write time.
+At boot only the sequence numbers are scanned; the newest record with a good CRC wins.
+Other EEPROM data (the discovery hashes) is queued with journalWriteWord() and goes through the same writer,
+one byte per tick between records.
+*/
+#ifndef STATE_JOURNAL_H
+#define STATE_JOURNAL_H
+
+#include "homeLights.h"
+
+#define journalQuietTime 2000
+#define journalMaxDelay 30000
+#define journalTickMs 5
+#define journalWordQueueSize 8
+
+// start the background writer
+void journalBegin();
+
+// journalRestore() results
+#define journalEmpty 0      // nothing was ever written
+#define journalRestored 1   // ports hold the newest record
+#define journalCleared 2    // cleared (or no readable record) - use the init states
+
+// newest valid record into ports
+uint8_t journalRestore(uint8_t* ports);
+
+// ledPorts changed - commit after the quiet period
+void journalNoteChange();
+
+// forget the stored states (next boot uses leds[] init states)
+void journalClear();
+
+// write value at address (outside the journal area) in the background; false if the queue is full
+bool journalWriteWord(uint16_t address, uint16_t value);
+
+// CRC-8 (polynomial 0x31) of the records, also used for the warm restart snapshot
+uint8_t crc8(const uint8_t* data, uint8_t len);
+
+#endif
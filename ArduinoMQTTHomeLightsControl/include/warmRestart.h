@@ -0,0 +1,37 @@
+/*
+Warm restart: the led states survive a reset in RAM.
+
+A copy of ledPorts with a magic byte and a CRC-8 is kept in .noinit RAM, which the C runtime does not clear,
+and updated after every change. After a reset that kept the RAM powered - the reset button (pin 6 is wired to
+RESET), the watchdog, a JTAG reset - setup() drives the output expanders from it before anything else, so the
+lights are back within milliseconds. After power on or a brown out (or when the copy does not check out) the
+states come from the EEPROM journal as before.
+
+The hardware watchdog (watchdogTimeout) resets a controller whose loop() stopped running; the longest legal
+blocking call is the 560 ms W5x00 reset in Ethernet.begin(). On the AVR the reset flags are read and the watchdog is stopped
+in .init3, before the Arduino core starts: after a watchdog reset it would otherwise fire again in 16 ms.
+*/
+#ifndef WARM_RESTART_H
+#define WARM_RESTART_H
+
+#include "homeLights.h"
+#include <avr/wdt.h>
+
+#define watchdogTimeout WDTO_4S
+
+// MCUSR of the last reset (PORF, EXTRF, BORF, WDRF, JTRF bits)
+extern uint8_t resetFlags;
+
+// true after a warm reset with a good snapshot, its ports are copied (noOfOutputExpanders bytes)
+bool warmRestartRestore(uint8_t* ports);
+
+// snapshot of ports, after every change of ledPorts
+void warmRestartSave(const uint8_t* ports);
+
+// no snapshot until the next warmRestartSave(): the next reset restores like a cold boot
+void warmRestartClear();
+
+// start the watchdog; loop() calls wdt_reset()
+void watchdogBegin();
+
+#endif
@@ -0,0 +1,222 @@
+/*
+Minimal Arduino core for the host build. Only what the sketch uses is provided.
+*/
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "NativeShim.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+
+char* utoa(unsigned int value, char* str, int base);
+char* itoa(int value, char* str, int base);
+char* ultoa(unsigned long value, char* str, int base);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// ATmega2560 external interrupts INT0..INT5 as numbered by the Arduino core
+inline int8_t digitalPinToInterrupt(uint8_t pin)
+{
+  return pin == 2 ? 0 : pin == 3 ? 1 : pin == 21 ? 2 : pin == 20 ? 3 : pin == 19 ? 4 : pin == 18 ? 5 : NOT_AN_INTERRUPT;
+}
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+// ATmega2560 ports as numbered by the Arduino core (PA = 1 .. PL = 12, no PI); PINx registers follow shimSetPin()
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t* portInputRegister(uint8_t port);
+
+// MCU status register with the cause of the last reset; 1 << PORF (power on) at start
+extern uint8_t MCUSR;
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+#define JTRF 4
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class String
+{
+  public:
+    String() {}
+    String(const char* s) : s_(s ? s : "") {}
+    String(const std::string& s) : s_(s) {}
+    String(char c) : s_(1, c) {}
+    String(int v) : s_(std::to_string(v)) {}
+    String(unsigned int v) : s_(std::to_string(v)) {}
+    String(long v) : s_(std::to_string(v)) {}
+    String(unsigned long v) : s_(std::to_string(v)) {}
+
+    const char* c_str() const { return s_.c_str(); }
+    unsigned int length() const { return s_.length(); }
+    bool reserve(unsigned int size) { s_.reserve(size); return true; }
+    bool concat(const char* s) { s_ += s; return true; }
+    bool concat(const char* s, unsigned int n) { s_.append(s, n); return true; }
+    bool concat(char c) { s_ += c; return true; }
+    bool concat(const String& s) { s_ += s.s_; return true; }
+
+    String& operator+=(const String& s) { s_ += s.s_; return *this; }
+    String& operator+=(const char* s) { s_ += s; return *this; }
+    String& operator+=(char c) { s_ += c; return *this; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String& a, const char* b) { return String(a.s_ + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s_); }
+
+    bool equals(const String& s) const { return s_ == s.s_; }
+    bool equals(const char* s) const { return s_ == s; }
+    bool operator==(const String& s) const { return s_ == s.s_; }
+    bool operator==(const char* s) const { return s_ == s; }
+
+    char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+    int indexOf(char c) const { size_t p = s_.find(c); return p == std::string::npos ? -1 : (int)p; }
+    int lastIndexOf(char c) const { size_t p = s_.rfind(c); return p == std::string::npos ? -1 : (int)p; }
+    String substring(unsigned int from) const { return from >= s_.size() ? String() : String(s_.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+      if (from > to) { unsigned int t = from; from = to; to = t; }
+      if (from >= s_.size()) return String();
+      return String(s_.substr(from, to - from));
+    }
+    void toCharArray(char* buf, unsigned int bufsize) const
+    {
+      if (!bufsize || !buf) return;
+      size_t n = s_.size() < bufsize - 1 ? s_.size() : bufsize - 1;
+      memcpy(buf, s_.data(), n);
+      buf[n] = 0;
+    }
+    void toUpperCase() { for (size_t i = 0; i < s_.size(); i++) s_[i] = (char)toupper((unsigned char)s_[i]); }
+    long toInt() const { return atol(s_.c_str()); }
+
+  private:
+    std::string s_;
+};
+
+class Print;
+
+class Printable
+{
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size)
+    {
+      size_t n = 0;
+      while (size--) n += write(*buf++);
+      return n;
+    }
+    size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const __FlashStringHelper* s) { return write((const char*)s); }
+    size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(int v, int base = DEC) { return print((long)v, base); }
+    size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+    size_t print(long v, int base = DEC)
+    {
+      if (base == DEC && v < 0) return print('-') + print((unsigned long)-v, base);
+      return print((unsigned long)v, base);
+    }
+    size_t print(unsigned long v, int base = DEC)
+    {
+      char buf[24];
+      snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", v);
+      return write(buf);
+    }
+    size_t print(double v, int digits = 2)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.*f", digits, v);
+      return write(buf);
+    }
+    size_t print(const Printable& p) { return p.printTo(*this); }
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& v) { size_t n = print(v); return n + println(); }
+    template <typename T> size_t println(const T& v, int base) { size_t n = print(v, base); return n + println(); }
+};
+
+class HardwareSerial : public Print
+{
+  public:
+    void begin(unsigned long baud);
+    int available() { return 0; }
+    int read() { return -1; }
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <Arduino.h>
+
+// 4 KB like the ATmega2560; erased cells read 0xFF. A cell write takes shimEepromWriteMicros, a write started
+// before the previous one is done waits for it like the AVR library does (shimEepromWrite()).
+class EEPROMClass
+{
+  public:
+    EEPROMClass() { memset(cells_, 0xFF, sizeof(cells_)); }
+    uint8_t read(int idx) { shimStats.eepromReads++; return cells_[idx]; }
+    void write(int idx, uint8_t val) { shimEepromWrite(); cells_[idx] = val; }
+    void update(int idx, uint8_t val) { if (read(idx) != val) write(idx, val); }
+    uint16_t length() { return sizeof(cells_); }
+    template <typename T> T& get(int idx, T& t)
+    {
+      uint8_t* p = (uint8_t*)&t;
+      for (size_t i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+      return t;
+    }
+    template <typename T> const T& put(int idx, const T& t)
+    {
+      const uint8_t* p = (const uint8_t*)&t;
+      for (size_t i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+      return t;
+    }
+
+  private:
+    uint8_t cells_[4096];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef NATIVE_ETHERNET_H
+#define NATIVE_ETHERNET_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Client.h>
+#include <PubSubClient.h>
+
+enum EthernetLinkStatus { Unknown, LinkON, LinkOFF };
+
+class EthernetClass
+{
+  public:
+    void init(uint8_t sspin) { (void)sspin; }
+    // like the Ethernet library, which waits 560 ms for the W5x00 reset
+    void begin(uint8_t* mac, IPAddress ip, IPAddress dns) { (void)mac; (void)dns; ip_ = ip; delay(560); }
+    IPAddress localIP() { return ip_; }
+    EthernetLinkStatus linkStatus() { return LinkON; }
+    int maintain() { return 0; }
+
+  private:
+    IPAddress ip_;
+};
+
+extern EthernetClass Ethernet;
+
+// Socket to the broker; every write() is one SPI burst + TCP segment on a real W5100.
+class EthernetClient : public Client
+{
+  public:
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char* host, uint16_t port);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size);
+    // only CONNACK is ever received, inbound PUBLISH goes straight to the callback (shimMqttInject)
+    int available() { return connected() ? connack_ : 0; }
+    int read() { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+    int read(uint8_t* buf, size_t size);
+    int peek() { return -1; }
+    void flush() {}
+    void stop() { connected_ = false; connack_ = 0; }
+    uint8_t connected() { return connected_ && shimBrokerUp; }
+    operator bool() { return connected_; }
+    void setConnectionTimeout(uint16_t timeout) { timeout_ = timeout; }
+
+  private:
+    bool connected_ = false;
+    uint8_t connack_ = 0;   // CONNACK bytes not read yet
+    uint16_t timeout_ = 1000; // W5100 default
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef NATIVE_IPADDRESS_H
+#define NATIVE_IPADDRESS_H
+
+#include <Arduino.h>
+
+class IPAddress : public Printable
+{
+  public:
+    IPAddress() { memset(bytes_, 0, sizeof(bytes_)); }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { bytes_[0] = a; bytes_[1] = b; bytes_[2] = c; bytes_[3] = d; }
+    uint8_t operator[](int i) const { return bytes_[i]; }
+    size_t printTo(Print& p) const
+    {
+      size_t n = 0;
+      for (int i = 0; i < 4; i++)
+      {
+        n += p.print(bytes_[i], DEC);
+        if (i < 3) n += p.print('.');
+      }
+      return n;
+    }
+
+  private:
+    uint8_t bytes_[4];
+};
+
+#endif
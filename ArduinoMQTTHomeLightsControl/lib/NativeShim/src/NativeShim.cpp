@@ -0,0 +1,777 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <TaskManagerIO.h>
+#include <avr/wdt.h>
+
+ShimStats shimStats;
+bool shimBrokerUp = true;
+bool shimBrokerHalfOpen = false;
+uint8_t shimNetFailWrites = 0;
+uint16_t shimBrokerSynAckMs = 0;
+bool shimSerialEcho = false;
+uint32_t shimWatchdogOverruns = 0;
+uint8_t MCUSR = 1 << PORF;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+TwoWire Wire;
+EthernetClass Ethernet;
+TaskManager taskManager;
+
+static uint64_t nowMicros = 0;
+static uint8_t pinLevel[70];
+static uint8_t pinModes[70];
+static bool pinsInitialised = false;
+
+struct ShimI2cDevice
+{
+  bool present;
+  uint8_t latch;
+  uint8_t externalLow;
+  uint8_t lastRead;
+  uint8_t intPin;
+};
+static ShimI2cDevice i2cDevices[128];
+static uint8_t i2cSdaHeldClocks = 0;   // SCL pulses until SDA is let go, 0: bus free
+
+struct ShimInterrupt
+{
+  void (*isr)();
+  int mode;
+};
+static ShimInterrupt pinInterrupts[6];
+
+static PubSubClient* activeMqttClient = nullptr;
+
+void shimResetStats()
+{
+  memset(&shimStats, 0, sizeof(shimStats));
+}
+
+// ---------------------------------------------------------------- time
+
+static uint64_t watchdogMicros = 0;   // 0: disabled
+static uint64_t watchdogResetAt = 0;
+
+static void watchdogCheck()
+{
+  if (!watchdogMicros || nowMicros - watchdogResetAt <= watchdogMicros) return;
+  shimWatchdogOverruns++;
+  watchdogResetAt = nowMicros;
+}
+
+void wdt_enable(uint8_t timeout)
+{
+  watchdogMicros = 16000ULL << timeout;
+  watchdogResetAt = nowMicros;
+}
+
+void wdt_disable() { watchdogMicros = 0; }
+void wdt_reset() { watchdogCheck(); watchdogResetAt = nowMicros; }
+
+void shimAdvanceMicros(uint32_t us) { nowMicros += us; watchdogCheck(); }
+uint64_t shimNowMicros() { return nowMicros; }
+
+unsigned long millis() { return (unsigned long)(nowMicros / 1000); }
+unsigned long micros() { return (unsigned long)nowMicros; }
+
+void delay(unsigned long ms)
+{
+  shimStats.blockedMs += ms;
+  nowMicros += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) { nowMicros += us; }
+
+long random(long howbig) { return howbig ? rand() % howbig : 0; }
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) { srand(seed); }
+
+static char* unsignedToString(unsigned long value, char* str, int base)
+{
+  char tmp[33];
+  int n = 0;
+  do
+  {
+    int d = value % base;
+    tmp[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+    value /= base;
+  } while (value);
+  for (int i = 0; i < n; i++) str[i] = tmp[n - 1 - i];
+  str[n] = 0;
+  return str;
+}
+
+char* utoa(unsigned int value, char* str, int base) { return unsignedToString(value, str, base); }
+char* ultoa(unsigned long value, char* str, int base) { return unsignedToString(value, str, base); }
+char* itoa(int value, char* str, int base)
+{
+  if (value < 0 && base == 10)
+  {
+    str[0] = '-';
+    unsignedToString((unsigned long)-(long)value, str + 1, base);
+    return str;
+  }
+  return unsignedToString((unsigned int)value, str, base);
+}
+
+// ---------------------------------------------------------------- pins
+
+// Mega 2560 pin -> port (high nibble, Arduino core numbering) and bit (low nibble), as in pins_arduino.h
+#define megaPin(port, bit) ((port) << 4 | (bit))
+#define PA 1
+#define PB 2
+#define PC 3
+#define PD 4
+#define PE 5
+#define PF 6
+#define PG 7
+#define PH 8
+#define PJ 10
+#define PK 11
+#define PL 12
+static const uint8_t megaPins[70] = {
+  megaPin(PE, 0), megaPin(PE, 1), megaPin(PE, 4), megaPin(PE, 5), megaPin(PG, 5), megaPin(PE, 3), megaPin(PH, 3),
+  megaPin(PH, 4), megaPin(PH, 5), megaPin(PH, 6), megaPin(PB, 4), megaPin(PB, 5), megaPin(PB, 6), megaPin(PB, 7),
+  megaPin(PJ, 1), megaPin(PJ, 0), megaPin(PH, 1), megaPin(PH, 0), megaPin(PD, 3), megaPin(PD, 2), megaPin(PD, 1),
+  megaPin(PD, 0), megaPin(PA, 0), megaPin(PA, 1), megaPin(PA, 2), megaPin(PA, 3), megaPin(PA, 4), megaPin(PA, 5),
+  megaPin(PA, 6), megaPin(PA, 7), megaPin(PC, 7), megaPin(PC, 6), megaPin(PC, 5), megaPin(PC, 4), megaPin(PC, 3),
+  megaPin(PC, 2), megaPin(PC, 1), megaPin(PC, 0), megaPin(PD, 7), megaPin(PG, 2), megaPin(PG, 1), megaPin(PG, 0),
+  megaPin(PL, 7), megaPin(PL, 6), megaPin(PL, 5), megaPin(PL, 4), megaPin(PL, 3), megaPin(PL, 2), megaPin(PL, 1),
+  megaPin(PL, 0), megaPin(PB, 3), megaPin(PB, 2), megaPin(PB, 1), megaPin(PB, 0), megaPin(PF, 0), megaPin(PF, 1),
+  megaPin(PF, 2), megaPin(PF, 3), megaPin(PF, 4), megaPin(PF, 5), megaPin(PF, 6), megaPin(PF, 7), megaPin(PK, 0),
+  megaPin(PK, 1), megaPin(PK, 2), megaPin(PK, 3), megaPin(PK, 4), megaPin(PK, 5), megaPin(PK, 6), megaPin(PK, 7)
+};
+static volatile uint8_t portInputs[13];
+
+uint8_t digitalPinToPort(uint8_t pin) { return pin < sizeof(megaPins) ? megaPins[pin] >> 4 : NOT_A_PORT; }
+uint8_t digitalPinToBitMask(uint8_t pin) { return pin < sizeof(megaPins) ? 1 << (megaPins[pin] & 7) : 0; }
+
+static void initPins()
+{
+  if (pinsInitialised) return;
+  memset(pinLevel, HIGH, sizeof(pinLevel));
+  for (uint8_t i = 0; i < sizeof(portInputs); i++) portInputs[i] = 0xFF;
+  pinsInitialised = true;
+}
+
+volatile uint8_t* portInputRegister(uint8_t port)
+{
+  initPins();
+  return port && port < sizeof(portInputs) ? &portInputs[port] : nullptr;
+}
+
+void shimSetPin(uint8_t pin, uint8_t level)
+{
+  initPins();
+  if (pin >= sizeof(pinLevel) || pinLevel[pin] == level) return;
+  pinLevel[pin] = level;
+  if (level) portInputs[digitalPinToPort(pin)] |= digitalPinToBitMask(pin);
+  else portInputs[digitalPinToPort(pin)] &= ~digitalPinToBitMask(pin);
+  int8_t n = digitalPinToInterrupt(pin);
+  if (n == NOT_AN_INTERRUPT || !pinInterrupts[n].isr) return;
+  int mode = pinInterrupts[n].mode;
+  if (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH)) pinInterrupts[n].isr();
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode)
+{
+  if (interruptNum >= 6) return;
+  pinInterrupts[interruptNum].isr = isr;
+  pinInterrupts[interruptNum].mode = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum)
+{
+  if (interruptNum < 6) pinInterrupts[interruptNum].isr = nullptr;
+}
+uint8_t shimGetPin(uint8_t pin) { initPins(); return pin < sizeof(pinLevel) ? pinLevel[pin] : HIGH; }
+
+static void i2cSclPulse();
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+  initPins();
+  if (pin < sizeof(pinModes)) pinModes[pin] = mode;
+  if (pin == 21 && mode == OUTPUT) i2cSclPulse();  // bus recovery pulls SCL low by making it an output
+}
+void digitalWrite(uint8_t pin, uint8_t val) { initPins(); if (pin < sizeof(pinLevel) && pinModes[pin] == OUTPUT) pinLevel[pin] = val; }
+int digitalRead(uint8_t pin) { return shimGetPin(pin); }
+
+// ---------------------------------------------------------------- serial
+
+// Like the AVR core: a 64 byte TX buffer emptied by the UART at the baud rate (10 bits per byte).
+// write() to a full buffer waits for the UART, that wait is counted as blocked time.
+#define shimSerialTxBuffer 64
+
+static uint32_t serialByteMicros = 0;   // 0 until begin()
+static uint64_t serialIdleAt = 0;       // time the UART has sent everything written so far
+static uint32_t serialBlockedMicros = 0;
+
+void HardwareSerial::begin(unsigned long baud) { serialByteMicros = baud ? 10000000UL / baud : 0; }
+
+int HardwareSerial::availableForWrite()
+{
+  if (!serialByteMicros || serialIdleAt <= nowMicros) return shimSerialTxBuffer;
+  uint64_t queued = (serialIdleAt - nowMicros + serialByteMicros - 1) / serialByteMicros;
+  return queued >= shimSerialTxBuffer ? 0 : shimSerialTxBuffer - (int)queued;
+}
+
+void HardwareSerial::flush()
+{
+  if (serialIdleAt <= nowMicros) return;
+  serialBlockedMicros += serialIdleAt - nowMicros;
+  nowMicros = serialIdleAt;
+  shimStats.blockedMs += serialBlockedMicros / 1000;
+  serialBlockedMicros %= 1000;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  shimStats.serialBytes++;
+  if (shimSerialEcho) putchar(c);
+  if (!serialByteMicros) return 1;
+  if (!availableForWrite())
+  {
+    uint64_t freeAt = serialIdleAt - (uint64_t)(shimSerialTxBuffer - 1) * serialByteMicros;
+    serialBlockedMicros += freeAt - nowMicros;
+    nowMicros = freeAt;
+    shimStats.blockedMs += serialBlockedMicros / 1000;
+    serialBlockedMicros %= 1000;
+  }
+  serialIdleAt = (serialIdleAt > nowMicros ? serialIdleAt : nowMicros) + serialByteMicros;
+  return 1;
+}
+
+// ---------------------------------------------------------------- EEPROM
+
+static uint64_t eepromIdleAt = 0;
+static uint32_t eepromBlockedMicros = 0;
+
+void shimEepromWrite()
+{
+  shimStats.eepromWrites++;
+  if (eepromIdleAt > nowMicros)
+  {
+    eepromBlockedMicros += eepromIdleAt - nowMicros;
+    nowMicros = eepromIdleAt;
+    shimStats.blockedMs += eepromBlockedMicros / 1000;
+    eepromBlockedMicros %= 1000;
+  }
+  eepromIdleAt = nowMicros + shimEepromWriteMicros;
+}
+
+// ---------------------------------------------------------------- I2C
+
+static uint8_t portValue(const ShimI2cDevice& dev) { return dev.latch & ~dev.externalLow; }
+
+// INT pins are wired-OR: LOW while any device on the pin has an unread change
+static void updateIntPin(uint8_t pin)
+{
+  if (pin == 0xFF) return;
+  uint8_t level = HIGH;
+  for (uint8_t a = 0; a < 128; a++)
+  {
+    const ShimI2cDevice& dev = i2cDevices[a];
+    if (dev.present && dev.intPin == pin && portValue(dev) != dev.lastRead) level = LOW;
+  }
+  shimSetPin(pin, level);
+}
+
+void shimI2cAddDevice(uint8_t address)
+{
+  ShimI2cDevice& dev = i2cDevices[address & 0x7F];
+  dev.present = true;
+  dev.latch = 0xFF;
+  dev.externalLow = 0;
+  dev.lastRead = 0xFF;
+  dev.intPin = 0xFF;
+}
+void shimI2cRemoveDevice(uint8_t address) { i2cDevices[address & 0x7F].present = false; }
+void shimI2cSetInputLow(uint8_t address, uint8_t lowMask)
+{
+  i2cDevices[address & 0x7F].externalLow = lowMask;
+  updateIntPin(i2cDevices[address & 0x7F].intPin);
+}
+uint8_t shimI2cLatch(uint8_t address) { return i2cDevices[address & 0x7F].latch; }
+void shimI2cSetIntPin(uint8_t address, uint8_t pin)
+{
+  i2cDevices[address & 0x7F].intPin = pin;
+  updateIntPin(pin);
+}
+
+void shimI2cHoldSda(uint8_t clocks)
+{
+  i2cSdaHeldClocks = clocks;
+  shimSetPin(20, clocks ? LOW : HIGH);
+}
+
+static void i2cSclPulse()
+{
+  if (!i2cSdaHeldClocks || i2cSdaHeldClocks == 0xFF) return;
+  if (!--i2cSdaHeldClocks) shimSetPin(20, HIGH);
+}
+
+// with SDA held low the master waits for the bus until its timeout (forever without one)
+double shimI2cBusMicros(const ShimStats& stats, uint32_t hz)
+{
+  bool fast = hz > 100000;
+  double start = fast ? 0.6 + 0.6 : 4.7 + 4.0;   // tSU;STA + tHD;STA
+  double stop = fast ? 0.6 + 1.3 : 4.0 + 4.7;    // tSU;STO + tBUF
+  return (stats.i2cAddressBytes + stats.i2cDataBytes) * 9 * 1e6 / hz + stats.i2cStarts * start + stats.i2cStops * stop;
+}
+
+// counts one transaction and moves the clock by its bus time
+static void i2cTransaction(uint32_t hz, uint8_t dataBytes, bool stop)
+{
+  static double carryMicros = 0;
+  ShimStats t = {};
+  t.i2cStarts = 1;
+  t.i2cStops = stop;
+  t.i2cAddressBytes = 1;
+  t.i2cDataBytes = dataBytes;
+  shimStats.i2cTransactions++;
+  shimStats.i2cStarts++;
+  shimStats.i2cStops += stop;
+  shimStats.i2cAddressBytes++;
+  shimStats.i2cDataBytes += dataBytes;
+  shimStats.i2cBytes += 1 + dataBytes;
+  carryMicros += shimI2cBusMicros(t, hz);
+  nowMicros += (uint64_t)carryMicros;
+  carryMicros -= (uint64_t)carryMicros;
+}
+
+bool TwoWire::timedOut()
+{
+  if (!i2cSdaHeldClocks) return false;
+  uint32_t waitUs = timeoutUs_ ? timeoutUs_ : 1000000;
+  nowMicros += waitUs;
+  shimStats.blockedMs += waitUs / 1000;
+  if (timeoutUs_) timeoutFlag_ = true;
+  return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+  txAddress_ = address;
+  txLen_ = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+  if (txLen_ >= sizeof(txBuf_)) return 0;
+  txBuf_[txLen_++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity)
+{
+  size_t n = 0;
+  while (quantity-- && write(*data++)) n++;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+  shimStats.i2cWrites++;
+  if (timedOut())
+  {
+    shimStats.i2cTransactions++;
+    shimStats.i2cStarts++;
+    return 5;
+  }
+  ShimI2cDevice& dev = i2cDevices[txAddress_ & 0x7F];
+  i2cTransaction(clock_, dev.present ? txLen_ : 0, sendStop);
+  if (!dev.present) return 2;
+  if (txLen_) dev.latch = txBuf_[txLen_ - 1];
+  updateIntPin(dev.intPin);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool sendStop)
+{
+  shimStats.i2cReads++;
+  rxLen_ = rxPos_ = 0;
+  if (timedOut())
+  {
+    shimStats.i2cTransactions++;
+    shimStats.i2cStarts++;
+    return 0;
+  }
+  ShimI2cDevice& dev = i2cDevices[address & 0x7F];
+  if (quantity > sizeof(rxBuf_)) quantity = sizeof(rxBuf_);
+  i2cTransaction(clock_, dev.present ? quantity : 0, sendStop);
+  if (!dev.present) return 0;
+  for (uint8_t i = 0; i < quantity; i++) rxBuf_[rxLen_++] = portValue(dev);
+  dev.lastRead = portValue(dev);
+  updateIntPin(dev.intPin);
+  return rxLen_;
+}
+
+// ---------------------------------------------------------------- Ethernet
+
+int EthernetClient::connect(IPAddress ip, uint16_t port)
+{
+  (void)ip;
+  (void)port;
+  if (!shimBrokerUp || shimBrokerSynAckMs > timeout_)
+  {
+    // Ethernet 2.0 gives up on a TCP connect after setConnectionTimeout() ms (1 s by default)
+    shimStats.blockedMs += timeout_;
+    nowMicros += (uint64_t)timeout_ * 1000;
+    connected_ = false;
+    return 0;
+  }
+  shimStats.blockedMs += shimBrokerSynAckMs;
+  nowMicros += (uint64_t)shimBrokerSynAckMs * 1000;
+  connected_ = true;
+  connack_ = 0;
+  return 1;
+}
+
+int EthernetClient::connect(const char* host, uint16_t port)
+{
+  (void)host;
+  return connect(IPAddress(), port);
+}
+
+size_t EthernetClient::write(const uint8_t* buf, size_t size)
+{
+  if (!connected()) return 0;
+  if (shimNetFailWrites)
+  {
+    shimNetFailWrites--;
+    connected_ = false;
+    return 0;
+  }
+  shimStats.netWrites++;
+  shimStats.netBytes += size;
+  // the broker answers CONNECT (the first packet of a write) with CONNACK, unless it is half open
+  if (size && (buf[0] & 0xF0) == MQTTCONNECT && !shimBrokerHalfOpen) connack_ = 4;
+  return size;
+}
+
+int EthernetClient::read(uint8_t* buf, size_t size)
+{
+  static const uint8_t connack[4] = {MQTTCONNACK, 2, 0, 0};
+  size_t n = 0;
+  for (; n < size && connack_; n++, connack_--) buf[n] = connack[4 - connack_];
+  return n ? (int)n : -1;
+}
+
+// ---------------------------------------------------------------- MQTT
+
+PubSubClient::PubSubClient(IPAddress addr, uint16_t p, Client& client)
+  : _client(&client), ip(addr), port(p), buffer(nullptr), bufferSize(0), nextMsgId(1),
+    _state(MQTT_DISCONNECTED), socketTimeout(15), callback(nullptr)
+{
+  setBufferSize(MQTT_MAX_PACKET_SIZE);
+  activeMqttClient = this;
+}
+
+PubSubClient::~PubSubClient()
+{
+  free(buffer);
+  if (activeMqttClient == this) activeMqttClient = nullptr;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)
+{
+  this->callback = callback;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+  if (size == 0) return false;
+  uint8_t* newBuffer = (uint8_t*)realloc(buffer, size);
+  if (!newBuffer) return false;
+  buffer = newBuffer;
+  bufferSize = size;
+  return true;
+}
+
+size_t PubSubClient::buildHeader(uint8_t header, uint8_t* buf, uint16_t length)
+{
+  uint8_t lenBuf[4];
+  uint8_t llen = 0;
+  uint16_t len = length;
+  do
+  {
+    uint8_t digit = len & 127;
+    len >>= 7;
+    if (len > 0) digit |= 0x80;
+    lenBuf[llen++] = digit;
+  } while (len > 0);
+  buf[4 - llen] = header;
+  for (int i = 0; i < llen; i++) buf[MQTT_MAX_HEADER_SIZE - llen + i] = lenBuf[i];
+  return llen + 1;
+}
+
+boolean PubSubClient::writeBuffer(uint8_t header, uint16_t length)
+{
+  uint16_t hlen = buildHeader(header, buffer, length);
+  uint16_t total = length + hlen;
+  return _client->write(buffer + (MQTT_MAX_HEADER_SIZE - hlen), total) == total;
+}
+
+uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t pos)
+{
+  const char* idp = string;
+  uint16_t i = 0;
+  pos += 2;
+  while (*idp && pos < bufferSize)
+  {
+    buf[pos++] = *idp++;
+    i++;
+  }
+  buf[pos - i - 2] = (i >> 8);
+  buf[pos - i - 1] = (i & 0xFF);
+  return pos;
+}
+
+boolean PubSubClient::connect(const char* id, const char* user, const char* pass)
+{
+  if (connected()) return true;
+  if (!_client->connected() && !_client->connect(ip, port))
+  {
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  uint16_t length = MQTT_MAX_HEADER_SIZE;
+  const uint8_t d[7] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 4};
+  memcpy(buffer + length, d, sizeof(d));
+  length += sizeof(d);
+  buffer[length++] = 0x02 | 0x80 | 0x40;
+  buffer[length++] = 0;
+  buffer[length++] = MQTT_KEEPALIVE;
+  length = writeString(id, buffer, length);
+  length = writeString(user, buffer, length);
+  length = writeString(pass, buffer, length);
+  writeBuffer(MQTTCONNECT, length - MQTT_MAX_HEADER_SIZE);
+  if (!_client->available())
+  {
+    // no CONNACK: PubSubClient waits for it up to the socket timeout
+    shimStats.blockedMs += socketTimeout * 1000UL;
+    nowMicros += socketTimeout * 1000000ULL;
+    _state = MQTT_CONNECTION_TIMEOUT;
+    _client->stop();
+    return false;
+  }
+  uint8_t connack[4];
+  if (_client->read(connack, 4) == 4 && connack[0] == MQTTCONNACK && connack[3] == 0)
+  {
+    _state = MQTT_CONNECTED;
+    return true;
+  }
+  _state = connack[3];
+  _client->stop();
+  return false;
+}
+
+void PubSubClient::disconnect()
+{
+  buffer[0] = MQTTDISCONNECT;
+  buffer[1] = 0;
+  _client->write(buffer, 2);
+  _state = MQTT_DISCONNECTED;
+  _client->stop();
+}
+
+boolean PubSubClient::connected()
+{
+  if (_state != MQTT_CONNECTED) return false;
+  if (_client->connected()) return true;
+  _state = MQTT_CONNECTION_LOST;
+  _client->stop();
+  return false;
+}
+
+boolean PubSubClient::loop()
+{
+  return connected();
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload)
+{
+  return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, false);
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload, boolean retained)
+{
+  return publish(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, retained);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength)
+{
+  return publish(topic, payload, plength, false);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained)
+{
+  if (!connected()) return false;
+  if (bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, bufferSize) + plength) return false;
+  uint16_t length = writeString(topic, buffer, MQTT_MAX_HEADER_SIZE);
+  memcpy(buffer + length, payload, plength);
+  length += plength;
+  shimStats.mqttPublishes++;
+  shimStats.mqttPublishBytes += strlen(topic) + plength;
+  return writeBuffer(MQTTPUBLISH | (retained ? 1 : 0), length - MQTT_MAX_HEADER_SIZE);
+}
+
+boolean PubSubClient::publish_P(const char* topic, const char* payload, boolean retained)
+{
+  return publish_P(topic, (const uint8_t*)payload, payload ? strlen(payload) : 0, retained);
+}
+
+// Like the real library: header and topic in one write, then one write per payload byte
+boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained)
+{
+  if (!connected()) return false;
+  unsigned int tlen = strnlen(topic, bufferSize);
+  uint16_t pos = MQTT_MAX_HEADER_SIZE;
+  pos = writeString(topic, buffer, pos);
+  size_t hlen = buildHeader(MQTTPUBLISH | (retained ? 1 : 0), buffer, plength + 2 + tlen);
+  size_t rc = _client->write(buffer + (MQTT_MAX_HEADER_SIZE - hlen), pos - (MQTT_MAX_HEADER_SIZE - hlen));
+  for (unsigned int i = 0; i < plength; i++) rc += _client->write(pgm_read_byte_near(payload + i));
+  shimStats.mqttPublishes++;
+  shimStats.mqttPublishBytes += tlen + plength;
+  return rc == hlen + 2 + tlen + plength;
+}
+
+boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, boolean retained)
+{
+  if (!connected()) return false;
+  uint16_t length = writeString(topic, buffer, MQTT_MAX_HEADER_SIZE);
+  size_t hlen = buildHeader(MQTTPUBLISH | (retained ? 1 : 0), buffer, plength + length - MQTT_MAX_HEADER_SIZE);
+  uint16_t total = length - (MQTT_MAX_HEADER_SIZE - hlen);
+  shimStats.mqttPublishes++;
+  shimStats.mqttPublishBytes += strlen(topic) + plength;
+  return _client->write(buffer + (MQTT_MAX_HEADER_SIZE - hlen), total) == total;
+}
+
+int PubSubClient::endPublish()
+{
+  return 1;
+}
+
+size_t PubSubClient::write(uint8_t c)
+{
+  return _client->write(c);
+}
+
+size_t PubSubClient::write(const uint8_t* buf, size_t size)
+{
+  return _client->write(buf, size);
+}
+
+boolean PubSubClient::subscribe(const char* topic, uint8_t qos)
+{
+  if (!connected()) return false;
+  if (bufferSize < 9 + strnlen(topic, bufferSize)) return false;
+  uint16_t length = MQTT_MAX_HEADER_SIZE;
+  nextMsgId++;
+  if (nextMsgId == 0) nextMsgId = 1;
+  buffer[length++] = (nextMsgId >> 8);
+  buffer[length++] = (nextMsgId & 0xFF);
+  length = writeString(topic, buffer, length);
+  buffer[length++] = qos;
+  shimStats.mqttSubscribes++;
+  return writeBuffer(MQTTSUBSCRIBE | MQTTQOS1, length - MQTT_MAX_HEADER_SIZE);
+}
+
+boolean PubSubClient::unsubscribe(const char* topic)
+{
+  if (!connected()) return false;
+  uint16_t length = MQTT_MAX_HEADER_SIZE;
+  nextMsgId++;
+  if (nextMsgId == 0) nextMsgId = 1;
+  buffer[length++] = (nextMsgId >> 8);
+  buffer[length++] = (nextMsgId & 0xFF);
+  length = writeString(topic, buffer, length);
+  return writeBuffer(MQTTUNSUBSCRIBE | MQTTQOS1, length - MQTT_MAX_HEADER_SIZE);
+}
+
+// The real library hands out pointers into its own buffer: topic null-terminated, payload right after
+void PubSubClient::inject(const char* topic, const uint8_t* payload, unsigned int length)
+{
+  if (!callback) return;
+  size_t tlen = strlen(topic);
+  if (tlen + 1 + length + 1 > bufferSize) return;
+  memcpy(buffer, topic, tlen + 1);
+  memcpy(buffer + tlen + 1, payload, length);
+  buffer[tlen + 1 + length] = 0;
+  callback((char*)buffer, buffer + tlen + 1, length);
+}
+
+void shimMqttInject(const char* topic, const char* payload)
+{
+  if (activeMqttClient) activeMqttClient->inject(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+// ---------------------------------------------------------------- task manager
+
+taskid_t TaskManager::add(uint32_t when, TimerFn fn, TimerUnit unit, bool repeat)
+{
+  uint64_t interval = unit == TIME_MICROS ? when : unit == TIME_SECONDS ? (uint64_t)when * 1000000 : (uint64_t)when * 1000;
+  for (taskid_t i = 0; i < DEFAULT_TASK_SIZE; i++)
+  {
+    if (!tasks_[i].active)
+    {
+      tasks_[i].fn = fn;
+      tasks_[i].interval = interval;
+      tasks_[i].nextRun = nowMicros + interval;
+      tasks_[i].repeat = repeat;
+      tasks_[i].active = true;
+      return i;
+    }
+  }
+  shimTasksRefused++;
+  return TASKMGR_INVALIDID;
+}
+
+uint16_t shimTasksRefused = 0;
+
+uint8_t shimTasksScheduled()
+{
+  uint8_t n = 0;
+  for (taskid_t i = 0; i < DEFAULT_TASK_SIZE; i++) n += taskManager.tasks_[i].active;
+  return n;
+}
+
+taskid_t TaskManager::scheduleOnce(uint32_t when, TimerFn timerFunction, TimerUnit timeUnit)
+{
+  return add(when, timerFunction, timeUnit, false);
+}
+
+taskid_t TaskManager::scheduleFixedRate(uint32_t when, TimerFn timerFunction, TimerUnit timeUnit)
+{
+  return add(when, timerFunction, timeUnit, true);
+}
+
+void TaskManager::cancelTask(taskid_t task)
+{
+  if (task < DEFAULT_TASK_SIZE) tasks_[task].active = false;
+}
+
+void TaskManager::runLoop()
+{
+  for (taskid_t i = 0; i < DEFAULT_TASK_SIZE; i++)
+  {
+    Task& t = tasks_[i];
+    if (!t.active || nowMicros < t.nextRun) continue;
+    if (t.repeat)
+    {
+      t.nextRun += t.interval;
+      if (t.nextRun <= nowMicros) t.nextRun = nowMicros + t.interval;
+    }
+    else
+    {
+      t.active = false;
+    }
+    t.fn();
+  }
+}
@@ -0,0 +1,88 @@
+/*
+NativeShim - host side stand-ins for the hardware used by ArduinoMQTTHomeLightsControl.
+
+Only compiled for [env:native]. Every "hardware" access is counted in shimStats, so the
+benchmarks can report I2C transactions, EEPROM writes or MQTT bytes per operation.
+Time is virtual: millis()/micros() only move when shimAdvanceMicros() or delay() is called, and by the bus
+time of every I2C transaction at the Wire clock (see shimI2cBusMicros).
+*/
+#ifndef NATIVE_SHIM_H
+#define NATIVE_SHIM_H
+
+#include <stdint.h>
+
+struct ShimStats
+{
+  uint32_t i2cTransactions;   // START ... STOP sequences
+  uint32_t i2cWrites;         // write transactions
+  uint32_t i2cReads;          // read transactions
+  uint32_t i2cBytes;          // address + data bytes on the bus
+  uint32_t i2cStarts;         // START conditions
+  uint32_t i2cStops;          // STOP conditions
+  uint32_t i2cAddressBytes;   // address + R/W bytes (a NACKed address ends the transaction)
+  uint32_t i2cDataBytes;
+  uint32_t eepromReads;
+  uint32_t eepromWrites;      // real cell writes (update() of an equal value is not counted)
+  uint32_t mqttPublishes;
+  uint32_t mqttPublishBytes;  // topic + payload bytes of PUBLISH packets
+  uint32_t mqttSubscribes;
+  uint32_t netWrites;         // write() calls reaching the Ethernet socket
+  uint32_t netBytes;
+  uint32_t serialBytes;
+  uint32_t blockedMs;         // time spent in delay(), waiting on socket timeouts or on a full Serial TX buffer
+};
+
+extern ShimStats shimStats;
+
+void shimResetStats();
+
+// virtual clock
+void shimAdvanceMicros(uint32_t us);
+uint64_t shimNowMicros();
+
+// Mega native pins: level seen by digitalRead(); buttons pull a pin LOW.
+// A level change runs the handler given to attachInterrupt() if the pin has one and the edge matches.
+void shimSetPin(uint8_t pin, uint8_t level);
+uint8_t shimGetPin(uint8_t pin);
+
+// PCF8574(A) devices on the I2C bus
+void shimI2cAddDevice(uint8_t address);
+void shimI2cRemoveDevice(uint8_t address);
+void shimI2cSetInputLow(uint8_t address, uint8_t lowMask); // external contacts pulling pins low
+uint8_t shimI2cLatch(uint8_t address);                     // last byte written to the device
+// wire the INT output of a device to a Mega pin (open drain, several devices may share a pin):
+// LOW while the port differs from what was read last, like a real PCF8574
+void shimI2cSetIntPin(uint8_t address, uint8_t pin);
+// a slave stopped in the middle of a byte holds SDA (pin 20) low: every transaction times out (after the
+// Wire.setWireTimeout() time) until SCL (pin 21) has been clocked by hand clocks times; 0xFF: never lets go
+void shimI2cHoldSda(uint8_t clocks);
+// Bus time of the counted I2C traffic at SCL clock hz, in µs: 9 clocks per byte (8 bits + ACK), plus per START
+// the setup and hold times and per STOP the setup time and bus free time of the I2C specification for the mode
+// (standard mode up to 100 kHz, fast mode above). Time spent by the Wire library between bytes is not included.
+double shimI2cBusMicros(const ShimStats& stats, uint32_t hz);
+
+// EEPROM cell write: counted, and busy-waits (blocked time) while the previous write is still in progress
+#define shimEepromWriteMicros 3300
+void shimEepromWrite();
+
+// MQTT broker
+extern bool shimBrokerUp;
+// the broker accepts TCP connections but never answers CONNECT (a half open broker or a hung process)
+extern bool shimBrokerHalfOpen;
+void shimMqttInject(const char* topic, const char* payload);
+// ms until the broker answers a TCP SYN (Wi-Fi, a busy host); connect() waits that long, or fails after its timeout
+extern uint16_t shimBrokerSynAckMs;
+// the next n socket writes fail and reset the connection (the peer went away under a send)
+extern uint8_t shimNetFailWrites;
+
+// taskManager: tasks scheduled now, and schedule calls refused because every slot was taken
+uint8_t shimTasksScheduled();
+extern uint16_t shimTasksRefused;
+
+// times the loop went longer than the wdt_enable() timeout without wdt_reset()
+extern uint32_t shimWatchdogOverruns;
+
+// echo Serial output to stdout
+extern bool shimSerialEcho;
+
+#endif
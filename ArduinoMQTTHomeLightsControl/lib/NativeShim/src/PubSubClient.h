@@ -0,0 +1,87 @@
+/*
+Host stand-in for knolleary/PubSubClient 2.8. Packets are encoded the same way as the real
+library and pushed to the Client, so socket writes and bytes on the wire can be counted.
+Broker availability is controlled by shimBrokerUp and shimBrokerHalfOpen; inbound messages come from shimMqttInject().
+connect() works like 2.8: an already connected socket is not connected again, and CONNACK is read from the socket.
+*/
+#ifndef NATIVE_PUBSUBCLIENT_H
+#define NATIVE_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Client.h>
+
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_KEEPALIVE 15
+
+#define MQTTCONNECT     1 << 4
+#define MQTTCONNACK     2 << 4
+#define MQTTPUBLISH     3 << 4
+#define MQTTSUBSCRIBE   8 << 4
+#define MQTTUNSUBSCRIBE 10 << 4
+#define MQTTDISCONNECT  14 << 4
+#define MQTTQOS1        (1 << 1)
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+class PubSubClient : public Print
+{
+  public:
+    PubSubClient(IPAddress ip, uint16_t port, Client& client);
+    ~PubSubClient();
+
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient& setClient(Client& client) { _client = &client; return *this; }
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() { return bufferSize; }
+    PubSubClient& setKeepAlive(uint16_t keepAlive) { (void)keepAlive; return *this; }
+    PubSubClient& setSocketTimeout(uint16_t timeout) { socketTimeout = timeout; return *this; }
+
+    boolean connect(const char* id, const char* user, const char* pass);
+    void disconnect();
+    boolean connected();
+    int state() { return _state; }
+    boolean loop();
+
+    boolean publish(const char* topic, const char* payload);
+    boolean publish(const char* topic, const char* payload, boolean retained);
+    boolean publish(const char* topic, const uint8_t* payload, unsigned int plength);
+    boolean publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained);
+    boolean publish_P(const char* topic, const char* payload, boolean retained);
+    boolean publish_P(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained);
+    boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
+    int endPublish();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buf, size_t size);
+
+    boolean subscribe(const char* topic) { return subscribe(topic, 0); }
+    boolean subscribe(const char* topic, uint8_t qos);
+    boolean unsubscribe(const char* topic);
+
+    // shim only: deliver an inbound PUBLISH to the callback
+    void inject(const char* topic, const uint8_t* payload, unsigned int length);
+
+  private:
+    size_t buildHeader(uint8_t header, uint8_t* buf, uint16_t length);
+    boolean writeBuffer(uint8_t header, uint16_t length);
+    uint16_t writeString(const char* string, uint8_t* buf, uint16_t pos);
+
+    Client* _client;
+    IPAddress ip;
+    uint16_t port;
+    uint8_t* buffer;
+    uint16_t bufferSize;
+    uint16_t nextMsgId;
+    int _state;
+    uint16_t socketTimeout;
+    MQTT_CALLBACK_SIGNATURE;
+};
+
+#endif
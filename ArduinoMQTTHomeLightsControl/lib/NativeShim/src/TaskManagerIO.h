@@ -0,0 +1,42 @@
+#ifndef NATIVE_TASKMANAGERIO_H
+#define NATIVE_TASKMANAGERIO_H
+
+#include <Arduino.h>
+
+typedef uint16_t taskid_t;
+#define TASKMGR_INVALIDID 0xffff
+// tasks scheduled at the same time, set for both builds in platformio.ini
+#ifndef DEFAULT_TASK_SIZE
+#define DEFAULT_TASK_SIZE 16
+#endif
+
+enum TimerUnit : uint8_t { TIME_MICROS = 0, TIME_SECONDS = 1, TIME_MILLIS = 2 };
+
+typedef void (*TimerFn)();
+
+// Cooperative scheduler driven by the virtual clock
+class TaskManager
+{
+  public:
+    taskid_t scheduleOnce(uint32_t when, TimerFn timerFunction, TimerUnit timeUnit = TIME_MILLIS);
+    taskid_t scheduleFixedRate(uint32_t when, TimerFn timerFunction, TimerUnit timeUnit = TIME_MILLIS);
+    void cancelTask(taskid_t task);
+    void runLoop();
+
+  private:
+    struct Task
+    {
+      TimerFn fn;
+      uint64_t nextRun;
+      uint64_t interval;
+      bool repeat;
+      bool active;
+    };
+    Task tasks_[DEFAULT_TASK_SIZE] = {};
+    taskid_t add(uint32_t when, TimerFn fn, TimerUnit unit, bool repeat);
+    friend uint8_t shimTasksScheduled();
+};
+
+extern TaskManager taskManager;
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include <Arduino.h>
+
+// I2C master talking to the modelled PCF8574(A) devices (see shimI2cAddDevice)
+class TwoWire
+{
+  public:
+    void begin() {}
+    void end() {}
+    // a transaction that takes longer than timeoutUs fails (endTransmission() 5, requestFrom() 0) and sets the flag
+    void setWireTimeout(uint32_t timeoutUs, bool resetWithTimeout = false) { timeoutUs_ = timeoutUs; (void)resetWithTimeout; }
+    bool getWireTimeoutFlag() const { return timeoutFlag_; }
+    void clearWireTimeoutFlag() { timeoutFlag_ = false; }
+    void setClock(uint32_t hz) { clock_ = hz; }
+    uint32_t getClock() const { return clock_; }
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t* data, size_t quantity);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+    int available() { return rxLen_ - rxPos_; }
+    int read() { return rxPos_ < rxLen_ ? rxBuf_[rxPos_++] : -1; }
+
+  private:
+    uint32_t clock_ = 100000;
+    uint32_t timeoutUs_ = 0;
+    bool timeoutFlag_ = false;
+    bool timedOut();
+    uint8_t txAddress_ = 0;
+    uint8_t txBuf_[32];
+    uint8_t txLen_ = 0;
+    uint8_t rxBuf_[32];
+    uint8_t rxLen_ = 0;
+    uint8_t rxPos_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
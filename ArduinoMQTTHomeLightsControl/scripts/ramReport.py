@@ -0,0 +1,52 @@
+# Static RAM report, run after the firmware is linked ([env:megaatmega2560] extra_scripts).
+#
+# Prints .data + .bss (+ .noinit) against the SRAM of the board, what is left for the stack and the heap,
+# and the biggest variables. Warns when less than stackReserve bytes are left. Discovery configs and diagnostics
+# are rendered into the static mqttMessage buffer, so they are counted here; the deepest stack is then a publish
+# (PubSubClient, Ethernet, SPI) from a task.
+#
+# Also works on its own: python3 scripts/ramReport.py firmware.elf [ram size] [nm] [size]
+
+import subprocess
+import sys
+
+stackReserve = 2048
+topSymbols = 15
+
+
+def ramReport(elf, ramSize, nmTool, sizeTool):
+    sections = {}
+    for line in subprocess.check_output([sizeTool, "-A", elf]).decode().splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0] in (".data", ".bss", ".noinit"):
+            sections[fields[0]] = int(fields[1])
+    used = sum(sections.values())
+    free = ramSize - used
+    print("RAM report: %s = %d of %d bytes, %d left for stack and heap" % (
+        " + ".join("%s %d" % (name, size) for name, size in sorted(sections.items())), used, ramSize, free))
+
+    symbols = []
+    for line in subprocess.check_output([nmTool, "--size-sort", "-S", "-C", elf]).decode().splitlines():
+        fields = line.split(None, 3)
+        if len(fields) == 4 and fields[2] in "bBdD":
+            symbols.append((int(fields[1], 16), fields[3]))
+    for size, name in sorted(symbols, reverse=True)[:topSymbols]:
+        print("  %6d  %s" % (size, name))
+
+    if free < stackReserve:
+        print("WARNING: only %d bytes of RAM left for stack and heap (want %d)" % (free, stackReserve))
+
+
+try:
+    Import("env")  # noqa: F821 - defined by PlatformIO (SCons)
+
+    def ramReportAction(source, target, env):
+        tools = env.subst("$CC")[:-len("gcc")]
+        ramSize = int(env.BoardConfig().get("upload.maximum_ram_size", 8192))
+        ramReport(str(target[0]), ramSize, tools + "nm", tools + "size")
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", ramReportAction)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        ramReport(sys.argv[1], int(sys.argv[2]) if len(sys.argv) > 2 else 8192,
+                  sys.argv[3] if len(sys.argv) > 3 else "avr-nm", sys.argv[4] if len(sys.argv) > 4 else "avr-size")
@@ -0,0 +1,71 @@
+#include "batchClient.h"
+#include "serialLog.h"
+#include <PubSubClient.h>
+
+int BatchClient::connect(IPAddress ip, uint16_t port)
+{
+  pending = 0;
+  connectSent = false;
+  lost = false;
+  return socket.connect(ip, port);
+}
+
+int BatchClient::connect(const char* host, uint16_t port)
+{
+  pending = 0;
+  connectSent = false;
+  lost = false;
+  return socket.connect(host, port);
+}
+
+bool BatchClient::writeSegment(const uint8_t* buf, size_t size)
+{
+  burstSegments++;
+  burstBytes += size;
+  if (socket.write(buf, size) == size) return true;
+  lost = true;
+  return false;
+}
+
+// A batch that fails to go out is dropped and latched in lost (see push())
+bool BatchClient::send()
+{
+  if (!pending) return true;
+  bool ok = writeSegment(batch, pending);
+  pending = 0;
+  return ok;
+}
+
+size_t BatchClient::write(const uint8_t* buf, size_t size)
+{
+  if (lost || !socket.connected()) return 0;
+  if (connectSent && size && (buf[0] & 0xF0) == MQTTCONNECT)
+  {
+    connectSent = false;
+    return size;
+  }
+  burstPackets++;
+  lastWrite = millis();
+  if (pending + size > batchSize && !send()) return 0;
+  if (size > batchSize) return writeSegment(buf, size) ? size : 0;
+  memcpy(batch + pending, buf, size);
+  pending += size;
+  return size;
+}
+
+void BatchClient::stop()
+{
+  send();  // DISCONNECT goes out before the socket closes
+  socket.stop();
+}
+
+void BatchClient::poll()
+{
+  send();
+  if (!burstPackets || millis() - lastWrite < batchBurstGapMs) return;
+  logDebug("MQTT burst: %u packets in %u segments, %lu bytes", burstPackets, burstSegments, (unsigned long)burstBytes);
+  packets += burstPackets;
+  segments += burstSegments;
+  bytes += burstBytes;
+  burstPackets = burstSegments = burstBytes = 0;
+}
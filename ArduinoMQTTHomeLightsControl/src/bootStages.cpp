@@ -0,0 +1,33 @@
+#include "bootStages.h"
+#include "warmRestart.h"
+#include "serialLog.h"
+#include "batchClient.h"
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+extern BatchClient mqttSocket;
+
+uint32_t bootStageUs[bootStages];
+
+static uint8_t bootDone = 0;   // bit per stage
+static bool bootReported = false;
+
+void bootStageDone(uint8_t stage)
+{
+  if (bootDone & (1 << stage)) return;
+  bootDone |= 1 << stage;
+  bootStageUs[stage] = millis() < 4000000UL ? micros() : 0xFFFFFFFFUL;
+}
+
+void bootReport(bool warm)
+{
+  if (bootReported) return;
+  bootStageDone(bootMqtt);
+  char payload[112];
+  int len = snprintf_P(payload, sizeof(payload),
+                       PSTR("{\"reset\":%u,\"warm\":%u,\"lights_us\":%lu,\"buttons_us\":%lu,\"network_us\":%lu,\"mqtt_us\":%lu}"),
+                       resetFlags, warm, (unsigned long)bootStageUs[bootLights], (unsigned long)bootStageUs[bootButtons],
+                       (unsigned long)bootStageUs[bootNetwork], (unsigned long)bootStageUs[bootMqtt]);
+  if (len <= 0 || len >= (int)sizeof(payload)) return;
+  bootReported = mqttClient.publish(bootTopic, (const uint8_t*)payload, len, true) && mqttSocket.push();
+}
@@ -0,0 +1,118 @@
+#include "buttonGestures.h"
+#include "buttonInputs.h"
+#include <TaskManagerIO.h>
+
+#define noKey 0xFF
+#define clicksDone 0xFF   // gesture reported, waiting for the release
+
+struct ClickCount
+{
+  uint8_t key;
+  uint8_t clicks;
+  bool down;
+  unsigned long releasedAt;
+};
+
+static ClickCount counting[gestureSlots];
+static const uint8_t* gestureTable;
+static size_t gestureTableSize;
+static void (*gestureReport)(uint8_t key, uint8_t gesture);
+
+// offset of the row after the one at row (rows: button, gesture, action, leds..., vL)
+static size_t gestureNextRow(size_t row)
+{
+  row += 3;
+  while (row < gestureTableSize && pgm_read_byte(gestureTable + row) != vL) row++;
+  return row + 1;
+}
+
+const uint8_t* gestureAction(uint8_t key, uint8_t gesture, uint8_t* action)
+{
+  for (size_t row = 0; row + 3 < gestureTableSize; row = gestureNextRow(row))
+  {
+    if (pgm_read_byte(gestureTable + row) != key || pgm_read_byte(gestureTable + row + 1) != gesture) continue;
+    *action = pgm_read_byte(gestureTable + row + 2);
+    return gestureTable + row + 3;
+  }
+  return nullptr;
+}
+
+// highest click count with an action on key, 1 if none
+static uint8_t gestureMaxClicks(uint8_t key)
+{
+  uint8_t clicks = 1;
+  for (size_t row = 0; row + 3 < gestureTableSize; row = gestureNextRow(row))
+  {
+    uint8_t gesture = pgm_read_byte(gestureTable + row + 1);
+    if (pgm_read_byte(gestureTable + row) == key && gesture != gestureLong && gesture + 1 > clicks) clicks = gesture + 1;
+  }
+  return clicks;
+}
+
+static ClickCount* countOf(uint8_t key)
+{
+  for (uint8_t i = 0; i < gestureSlots; i++)
+    if (counting[i].key == key) return &counting[i];
+  return nullptr;
+}
+
+// clicks: 1 single, 2 double, 3 or more triple
+static void reportClicks(ClickCount& c, uint8_t clicks)
+{
+  c.clicks = clicksDone;
+  if (clicks) gestureReport(c.key, clicks > 3 ? gestureTriple : clicks - 1);
+}
+
+void gesturesInput(uint8_t key, uint8_t event)
+{
+  ClickCount* c = countOf(key);
+  if (event == inputPressed)
+  {
+    if (!c)
+    {
+      uint8_t maxClicks = gestureMaxClicks(key);
+      if (maxClicks == 1 || !(c = countOf(noKey)))
+      {
+        gestureReport(key, gestureSingle);  // the common case: no wait
+        return;
+      }
+      c->key = key;
+      c->clicks = 0;
+    }
+    c->down = true;
+    if (++c->clicks >= gestureMaxClicks(key)) reportClicks(*c, c->clicks);
+  }
+  else if (event == inputHeld)
+  {
+    if (c && c->clicks == clicksDone) return;
+    if (c) reportClicks(*c, c->clicks - 1); // the clicks before the one held
+    gestureReport(key, gestureLong);
+  }
+  else if (c)
+  {
+    c->down = false;
+    c->releasedAt = millis();
+    if (c->clicks == clicksDone) c->key = noKey;
+  }
+}
+
+static void gesturesTask()
+{
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < gestureSlots; i++)
+  {
+    ClickCount& c = counting[i];
+    if (c.key == noKey || c.down || now - c.releasedAt < gestureClickGapMs) continue;
+    reportClicks(c, c.clicks);
+    c.key = noKey;
+  }
+}
+
+void gesturesBegin(const uint8_t* table, size_t tableSize, void (*onGesture)(uint8_t key, uint8_t gesture))
+{
+  gestureTable = table;
+  gestureTableSize = tableSize;
+  gestureReport = onGesture;
+  for (uint8_t i = 0; i < gestureSlots; i++) counting[i].key = noKey;
+  taskManager.scheduleFixedRate(gestureTickMs, gesturesTask);
+}
@@ -0,0 +1,212 @@
+#include "buttonInputs.h"
+#include "buttonMap.h"
+#include "latencyStats.h"
+#include "i2cBus.h"
+#include <TaskManagerIO.h>
+
+#define inputHoldTicks (inputHoldMs / inputTickMs)
+#define inputPollTicks (inputPollMs / inputTickMs)
+#define inputSafetyPollTicks (inputSafetyPollMs / inputTickMs)
+#define noKey 0xFF
+
+struct InputExpander
+{
+  uint8_t address;
+  uint8_t firstKey;
+  uint8_t intPin;
+  int8_t interrupt;   // external interrupt of intPin, NOT_AN_INTERRUPT if none
+  uint8_t pressed;    // debounced, 1 = pressed
+  uint8_t ct0, ct1;   // vertical counter
+  bool active;        // raw differs from pressed - keep sampling
+  uint32_t changedAt; // micros() of the read that made it active
+};
+
+// Arduino pins on one AVR port
+struct InputPort
+{
+  volatile uint8_t* pins;   // PINx register
+  uint8_t mask;             // bits with a button
+  uint8_t pressed;
+  uint8_t ct0, ct1;
+  bool active;
+  uint32_t changedAt;
+  uint8_t keys[8];          // button PIN number of each bit
+};
+
+struct HeldKey
+{
+  uint8_t key;
+  uint8_t ticks;
+};
+
+
+static InputExpander expanders[maxInputExpanders];
+static uint8_t noOfExpanders = 0;
+static InputPort ports[maxInputPorts];
+static uint8_t noOfPorts = 0;
+static HeldKey heldKeys[inputHoldSlots];
+static void (*inputOnEvent)(uint8_t key, uint8_t event);
+static uint16_t inputTicks = 0;
+
+// external interrupts that fired since the last tick, bit n = INTn
+static volatile uint8_t inputInterrupts = 0;
+
+static void inputIsr0() { inputInterrupts |= 0x01; }
+static void inputIsr1() { inputInterrupts |= 0x02; }
+static void inputIsr2() { inputInterrupts |= 0x04; }
+static void inputIsr3() { inputInterrupts |= 0x08; }
+static void inputIsr4() { inputInterrupts |= 0x10; }
+static void inputIsr5() { inputInterrupts |= 0x20; }
+static void (* const inputIsrs[])() = {inputIsr0, inputIsr1, inputIsr2, inputIsr3, inputIsr4, inputIsr5};
+
+// 2 bit vertical counter (4 equal samples) debounce of 8 inputs at once; raw and state: 1 = pressed.
+// Returns the bits of state that toggled.
+static inline uint8_t debounce8(uint8_t raw, uint8_t& state, uint8_t& ct0, uint8_t& ct1)
+{
+  uint8_t changed = state ^ raw;
+  ct0 = ~(ct0 & changed);
+  ct1 = ct0 ^ (ct1 & changed);
+  changed &= ct0 & ct1;
+  state ^= changed;
+  return changed;
+}
+
+static void holdStart(uint8_t key)
+{
+  for (uint8_t i = 0; i < inputHoldSlots; i++)
+  {
+    if (heldKeys[i].key != noKey) continue;
+    heldKeys[i].key = key;
+    heldKeys[i].ticks = 0;
+    return;
+  }
+}
+
+static void holdStop(uint8_t key)
+{
+  for (uint8_t i = 0; i < inputHoldSlots; i++)
+    if (heldKeys[i].key == key) heldKeys[i].key = noKey;
+}
+
+static void holdTick()
+{
+  for (uint8_t i = 0; i < inputHoldSlots; i++)
+  {
+    HeldKey& h = heldKeys[i];
+    if (h.key == noKey || h.ticks > inputHoldTicks) continue;
+    if (++h.ticks > inputHoldTicks) inputOnEvent(h.key, inputHeld);
+  }
+}
+
+// a debounced button changed; changedAt: when its source was first seen changing
+static void inputEvent(uint8_t key, bool pressed, uint32_t changedAt)
+{
+  if (!buttonConfigured(key)) return;
+  if (pressed)
+  {
+    holdStart(key);
+    latencyRecord(latencyDetect, micros() - changedAt);
+    latencyEventBegin(latencyPressToLight, changedAt);
+    inputOnEvent(key, inputPressed);
+    latencyEventEnd();
+  }
+  else
+  {
+    holdStop(key);
+    inputOnEvent(key, inputReleased);
+  }
+}
+
+static bool expanderDue(const InputExpander& x, uint8_t fired)
+{
+  if (x.active) return true;
+  if (x.intPin == noIntPin) return inputTicks % inputPollTicks == 0;
+  if (x.interrupt != NOT_AN_INTERRUPT && (fired & (1 << x.interrupt))) return true;
+  return digitalRead(x.intPin) == LOW || inputTicks % inputSafetyPollTicks == 0;
+}
+
+static void buttonInputsTask()
+{
+  noInterrupts();
+  uint8_t fired = inputInterrupts;
+  inputInterrupts = 0;
+  interrupts();
+
+  for (uint8_t i = 0; i < noOfExpanders; i++)
+  {
+    InputExpander& x = expanders[i];
+    if (!expanderDue(x, fired)) continue;
+    uint8_t raw;
+    if (!i2cRead(x.address, &raw)) continue;
+    raw = ~raw;  // buttons pull the pins LOW
+    if (!x.active && raw != x.pressed) x.changedAt = micros();
+    uint8_t toggled = debounce8(raw, x.pressed, x.ct0, x.ct1);
+    x.active = raw != x.pressed;
+    for (uint8_t b = 0; toggled; b++, toggled >>= 1)
+      if (toggled & 1) inputEvent(x.firstKey + b, x.pressed & (1 << b), x.changedAt);
+  }
+  for (uint8_t i = 0; i < noOfPorts; i++)
+  {
+    InputPort& p = ports[i];
+    uint8_t raw = ~*p.pins & p.mask;
+    if (!p.active && raw != p.pressed) p.changedAt = micros();
+    uint8_t toggled = debounce8(raw, p.pressed, p.ct0, p.ct1);
+    p.active = raw != p.pressed;
+    for (uint8_t b = 0; toggled; b++, toggled >>= 1)
+      if (toggled & 1) inputEvent(p.keys[b], p.pressed & (1 << b), p.changedAt);
+  }
+  holdTick();
+  inputTicks++;
+}
+
+void buttonInputsAddPin(uint8_t pin)
+{
+  uint8_t port = digitalPinToPort(pin);
+  uint8_t bit = digitalPinToBitMask(pin);
+  if (port == NOT_A_PORT || !bit) return;
+  volatile uint8_t* pins = portInputRegister(port);
+  InputPort* p = nullptr;
+  for (uint8_t i = 0; i < noOfPorts && !p; i++)
+    if (ports[i].pins == pins) p = &ports[i];
+  if (!p)
+  {
+    if (noOfPorts >= maxInputPorts) return;
+    p = &ports[noOfPorts++];
+    p->pins = pins;
+    p->mask = 0;
+    p->pressed = 0;
+    p->ct0 = p->ct1 = 0xFF;
+    p->active = false;
+  }
+  pinMode(pin, INPUT_PULLUP);
+  p->mask |= bit;
+  uint8_t b = 0;
+  while (!(bit & (1 << b))) b++;
+  p->keys[b] = pin;
+}
+
+void buttonInputsAddExpander(uint8_t address, uint8_t firstKey, uint8_t intPin)
+{
+  if (noOfExpanders >= maxInputExpanders) return;
+  InputExpander& x = expanders[noOfExpanders++];
+  x.address = address;
+  x.firstKey = firstKey;
+  x.intPin = intPin;
+  x.interrupt = intPin == noIntPin ? NOT_AN_INTERRUPT : digitalPinToInterrupt(intPin);
+  x.pressed = 0;
+  x.ct0 = x.ct1 = 0xFF;
+  x.active = true;  // read at the first tick
+  x.changedAt = 0;
+  // quasi-bidirectional pins: writing 1s makes them inputs with a weak pull-up
+  i2cWrite(address, 0xFF);
+  if (intPin == noIntPin) return;
+  pinMode(intPin, INPUT_PULLUP);
+  if (x.interrupt != NOT_AN_INTERRUPT) attachInterrupt(x.interrupt, inputIsrs[x.interrupt], FALLING);
+}
+
+void buttonInputsBegin(void (*onEvent)(uint8_t key, uint8_t event))
+{
+  inputOnEvent = onEvent;
+  for (uint8_t i = 0; i < inputHoldSlots; i++) heldKeys[i].key = noKey;
+  taskManager.scheduleFixedRate(inputTickMs, buttonInputsTask);
+}
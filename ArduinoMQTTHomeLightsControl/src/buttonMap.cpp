@@ -0,0 +1,80 @@
+#include "buttonMap.h"
+#include "ledStates.h"
+#include "serialLog.h"
+
+uint8_t noOfButtons = 0;
+
+static uint8_t buttonLedStart[startLedNo + 1];
+static uint8_t buttonLedList[maxButtonLedLinks];
+static uint8_t buttonMask[(startLedNo + 7) / 8];
+
+bool buttonConfigured(uint8_t key)
+{
+  return key < startLedNo && (buttonMask[key >> 3] & (1 << (key & 7)));
+}
+
+uint8_t buttonLeds(uint8_t key, const uint8_t** leds)
+{
+  if (key >= startLedNo) return 0;
+  *leds = &buttonLedList[buttonLedStart[key]];
+  return buttonLedStart[key + 1] - buttonLedStart[key];
+}
+
+// led number as written in button2leds -> its bit in ledPorts
+static uint8_t tableLedBit(uint8_t led)
+{
+  return led < 256 - startLedNo ? ledBit(led + startLedNo) : noLedBit;
+}
+
+// Both passes keep the same (first maxButtonLedLinks) valid links, so they always agree
+void buttonMapBuild(const uint8_t* table, size_t tableSize)
+{
+  memset(buttonLedStart, 0, sizeof(buttonLedStart));
+  memset(buttonMask, 0, sizeof(buttonMask));
+  noOfButtons = 0;
+  uint16_t links = 0;
+
+  // 1st pass: mark buttons and count their leds in buttonLedStart[key+1]
+  for (size_t i = 0; i < tableSize; i++)
+  {
+    uint8_t key = pgm_read_byte(&table[i]);
+    bool used = key < startLedNo;
+    if (used && !buttonConfigured(key))
+    {
+      buttonMask[key >> 3] |= 1 << (key & 7);
+      noOfButtons++;
+    }
+    while (++i < tableSize)
+    {
+      uint8_t led = pgm_read_byte(&table[i]);
+      if (led == vL) break;
+      if (tableLedBit(led) == noLedBit) continue;
+      if (used && links < maxButtonLedLinks) buttonLedStart[key + 1]++;
+      links++;
+    }
+  }
+  if (links > maxButtonLedLinks)
+  {
+    logError("button2leds has more leds than maxButtonLedLinks, ignored: %u", (unsigned int)(links - maxButtonLedLinks));
+  }
+  for (uint16_t k = 1; k <= startLedNo; k++) buttonLedStart[k] += buttonLedStart[k - 1];
+
+  // 2nd pass: fill the list, using buttonLedStart[key] as the write cursor
+  links = 0;
+  for (size_t i = 0; i < tableSize; i++)
+  {
+    uint8_t key = pgm_read_byte(&table[i]);
+    while (++i < tableSize)
+    {
+      uint8_t led = pgm_read_byte(&table[i]);
+      if (led == vL) break;
+      uint8_t bit = tableLedBit(led);
+      if (bit == noLedBit) continue;
+      if (key < startLedNo && links < maxButtonLedLinks) buttonLedList[buttonLedStart[key]++] = bit;
+      links++;
+    }
+  }
+  // cursors now point at the end of each slice - shift them back to the start
+  for (uint16_t k = startLedNo; k > 0; k--) buttonLedStart[k] = buttonLedStart[k - 1];
+  buttonLedStart[0] = 0;
+}
@@ -0,0 +1,40 @@
+#include "deviceRegistry.h"
+
+uint8_t registryLeds = 0;
+uint8_t registryButtons = 0;
+
+static const LedEntry* ledTable;
+static const ButtonEntry* buttonTable;
+
+void registryBegin(const LedEntry* leds, uint8_t noOfLeds, const ButtonEntry* buttons, uint8_t noOfButtons)
+{
+  ledTable = leds;
+  registryLeds = noOfLeds;
+  buttonTable = buttons;
+  registryButtons = noOfButtons;
+}
+
+uint8_t registryLedNo(uint8_t i)
+{
+  return pgm_read_byte(&ledTable[i].ledNo);
+}
+
+uint8_t registryLedInitState(uint8_t i)
+{
+  return pgm_read_byte(&ledTable[i].ledInitState);
+}
+
+uint16_t registryLedAutoOff(uint8_t i)
+{
+  return pgm_read_word(&ledTable[i].ledAutoOffS);
+}
+
+void registryLed(uint8_t i, LedEntry& led)
+{
+  memcpy_P(&led, &ledTable[i], sizeof(LedEntry));
+}
+
+void registryButton(uint8_t i, ButtonEntry& button)
+{
+  memcpy_P(&button, &buttonTable[i], sizeof(ButtonEntry));
+}
@@ -0,0 +1,37 @@
+#include "diagCounters.h"
+#include "mqttConnection.h"
+#include "mqttEncoder.h"
+#include "publishQueue.h"
+#include <TaskManagerIO.h>
+
+static unsigned long lastReport;
+static bool reportRequested = false;
+
+size_t diagCountersRender(char* payload, size_t size)
+{
+  int n = snprintf_P(payload, size, PSTR("{\"publish\":[%lu,%u,%u,%u]}"), (unsigned long)publishSent, publishDropped,
+                     publishFailed, publishQueueDepth());
+  return n < 0 || (size_t)n >= size ? 0 : n;
+}
+
+static void diagCountersTask()
+{
+  unsigned long now = millis();
+  if (!reportRequested && (!diagReportMs || now - lastReport < diagReportMs)) return;
+  if (!mqttConnected) return;
+  size_t len = diagCountersRender(mqttMessage, mqttMessageMax);
+  if (len && !mqttClient.publish(countersTopic, (const uint8_t*)mqttMessage, len)) return;
+  lastReport = now;
+  reportRequested = false;
+}
+
+void diagCountersRequestReport()
+{
+  reportRequested = true;
+}
+
+void diagCountersBegin()
+{
+  lastReport = millis();
+  taskManager.scheduleFixedRate(diagTickMs, diagCountersTask);
+}
@@ -0,0 +1,82 @@
+#include "discovery.h"
+#include "ledStates.h"
+#include "mqttConnection.h"
+#include "batchClient.h"
+#include "stateJournal.h"
+#include <EEPROM.h>
+#include <TaskManagerIO.h>
+
+extern BatchClient mqttSocket;
+
+// hash slots: button PINs 0..startLedNo-1, then led bits
+#define discoverySlots (startLedNo + noOfLedBits)
+#define discoveryNoHash 0xFFFF
+
+static_assert(discoverySlots * 2 <= eepromDiscoverySize, "discovery hashes do not fit in their EEPROM area");
+
+static uint16_t discoveryEntities = 0;
+static DiscoveryRender discoveryRender = nullptr;
+static uint16_t discoveryNext = 0;
+static bool discoveryForce = false;
+static char discoveryTopic[discoveryTopicMax];
+
+static int16_t discoverySlot(uint8_t key)
+{
+  if (key < startLedNo) return key;
+  uint8_t bit = ledBit(key);
+  return bit == noLedBit ? -1 : startLedNo + bit;
+}
+
+// FNV-1a folded to 16 bits; never discoveryNoHash (erased EEPROM)
+static uint16_t discoveryHash(const char* topic, const char* payload, uint16_t length)
+{
+  uint32_t h = 2166136261UL;
+  for (const char* p = topic; *p; p++) h = (h ^ (uint8_t)*p) * 16777619UL;
+  h *= 16777619UL; // a 0 between topic and payload
+  for (uint16_t i = 0; i < length; i++) h = (h ^ (uint8_t)payload[i]) * 16777619UL;
+  uint16_t folded = (h >> 16) ^ (h & 0xFFFF);
+  return folded == discoveryNoHash ? folded - 1 : folded;
+}
+
+static void discoveryTask()
+{
+  if (!mqttConnected || discoveryNext >= discoveryEntities) return;
+  char* topic = discoveryTopic;
+  char* payload = mqttMessage;
+  uint8_t published = 0;
+  for (uint8_t checks = 0; checks < discoveryChecksPerTick && published < discoveryPerTick && discoveryNext < discoveryEntities; checks++)
+  {
+    uint8_t key = 0;
+    topic[0] = 0;
+    uint16_t length = discoveryRender(discoveryNext, &key, topic, payload);
+    int16_t slot = discoverySlot(key);
+    uint16_t hash = discoveryHash(topic, payload, length);
+    uint16_t stored = discoveryNoHash;
+    if (slot >= 0) EEPROM.get(eepromDiscoveryStart + 2 * slot, stored);
+    if (!discoveryForce && stored == hash)
+    {
+      discoveryNext++;
+      continue;
+    }
+    // retried on the next tick; the hash is only stored once the config reached the socket
+    if (!mqttClient.publish(topic, (const uint8_t*)payload, length, true) || !mqttSocket.push()) return;
+    // through the journal writer, one byte per tick; a hash that does not fit the queue only costs a resend
+    if (slot >= 0) journalWriteWord(eepromDiscoveryStart + 2 * slot, hash);
+    published++;
+    discoveryNext++;
+  }
+}
+
+void discoveryBegin(uint16_t noOfEntities, DiscoveryRender render)
+{
+  discoveryEntities = noOfEntities;
+  discoveryRender = render;
+  discoveryNext = noOfEntities; // nothing to do until the first connect
+  taskManager.scheduleFixedRate(discoveryTickMs, discoveryTask);
+}
+
+void discoveryRestart(bool force)
+{
+  discoveryNext = 0;
+  discoveryForce = force;
+}
@@ -0,0 +1,181 @@
+#include "i2cBus.h"
+#include "mqttConnection.h"
+#include "mqttEncoder.h"
+#include "serialLog.h"
+#include <Wire.h>
+#include <TaskManagerIO.h>
+
+uint16_t i2cRecoveries = 0;
+
+struct I2cDevice
+{
+  uint8_t address;
+  uint8_t failsInRow;       // failed transactions (after the retries) in a row
+  bool quarantined;
+  unsigned long quarantinedAt;
+  uint32_t transactions;    // attempts on the bus
+  uint16_t failed;          // failed attempts
+  uint16_t maxUs;
+};
+
+static I2cDevice devices[i2cMaxDevices];
+static uint8_t noOfDevices = 0;
+
+static bool reportRequested = false;
+static unsigned long lastReport = 0;
+
+static void i2cWireBegin()
+{
+  Wire.begin();
+  Wire.setWireTimeout(i2cTimeoutUs, true);
+}
+
+// A slave stopped in the middle of a byte holds SDA low until it has clocked out its bits:
+// clock SCL by hand until SDA is released, then a STOP. The pins are driven open drain (LOW or let go).
+static void i2cBusRecover()
+{
+  Wire.end();
+  pinMode(i2cSdaPin, INPUT_PULLUP);
+  pinMode(i2cSclPin, INPUT_PULLUP);
+  for (uint8_t i = 0; i < 9 && digitalRead(i2cSdaPin) == LOW; i++)
+  {
+    digitalWrite(i2cSclPin, LOW);
+    pinMode(i2cSclPin, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(i2cSclPin, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+  digitalWrite(i2cSdaPin, LOW);
+  pinMode(i2cSdaPin, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(i2cSdaPin, INPUT_PULLUP);  // SDA rising while SCL is high: STOP
+  i2cWireBegin();
+  i2cRecoveries++;
+  logWarn("I2C bus recovered, SDA %s", digitalRead(i2cSdaPin) == LOW ? "still low" : "free");
+}
+
+static I2cDevice* deviceOf(uint8_t address)
+{
+  for (uint8_t i = 0; i < noOfDevices; i++)
+    if (devices[i].address == address) return &devices[i];
+  if (noOfDevices == i2cMaxDevices) return nullptr;
+  I2cDevice& d = devices[noOfDevices++];
+  memset(&d, 0, sizeof(d));
+  d.address = address;
+  return &d;
+}
+
+// one transaction on the bus, recovering it after a timeout
+static bool i2cAttempt(uint8_t address, bool write, uint8_t* value)
+{
+  bool ok;
+  if (write)
+  {
+    Wire.beginTransmission(address);
+    Wire.write(*value);
+    ok = Wire.endTransmission() == 0;
+  }
+  else
+  {
+    ok = Wire.requestFrom(address, (uint8_t)1) == 1;
+    if (ok) *value = Wire.read();
+  }
+  if (Wire.getWireTimeoutFlag())
+  {
+    Wire.clearWireTimeoutFlag();
+    i2cBusRecover();
+  }
+  return ok;
+}
+
+static bool i2cTransfer(uint8_t address, bool write, uint8_t* value)
+{
+  I2cDevice* d = deviceOf(address);
+  if (!d) return i2cAttempt(address, write, value);  // more chips than i2cMaxDevices: not tracked
+  uint8_t attempts = 1 + i2cRetries;
+  if (d->quarantined)
+  {
+    if (millis() - d->quarantinedAt < i2cQuarantineMs) return false;
+    attempts = 1;
+  }
+  bool ok = false;
+  while (attempts-- && !ok)
+  {
+    uint32_t start = micros();
+    ok = i2cAttempt(address, write, value);
+    uint32_t us = micros() - start;
+    d->transactions++;
+    if (us > d->maxUs) d->maxUs = us > 0xFFFF ? 0xFFFF : us;
+    if (!ok && d->failed < 0xFFFF) d->failed++;
+  }
+  if (ok)
+  {
+    d->failsInRow = 0;
+    if (d->quarantined)
+    {
+      d->quarantined = false;
+      reportRequested = true;
+      logWarn("I2C 0x%02x answers again", address);
+    }
+    return true;
+  }
+  if (d->failsInRow < 0xFF) d->failsInRow++;
+  if (!d->quarantined && d->failsInRow >= i2cQuarantineErrors)
+  {
+    d->quarantined = true;
+    reportRequested = true;
+    logError("I2C 0x%02x quarantined after %u failures", address, d->failsInRow);
+  }
+  if (d->quarantined) d->quarantinedAt = millis();
+  return false;
+}
+
+bool i2cWrite(uint8_t address, uint8_t value)
+{
+  return i2cTransfer(address, true, &value);
+}
+
+bool i2cRead(uint8_t address, uint8_t* value)
+{
+  return i2cTransfer(address, false, value);
+}
+
+size_t i2cHealthRender(char* payload, size_t size)
+{
+  int n = snprintf_P(payload, size, PSTR("{\"recoveries\":%u"), i2cRecoveries);
+  if (n < 0 || (size_t)n + 2 > size) return 0;
+  size_t len = n;
+  for (uint8_t i = 0; i < noOfDevices; i++)
+  {
+    const I2cDevice& d = devices[i];
+    n = snprintf_P(payload + len, size - len, PSTR(",\"%02x\":[%lu,%u,%u,%u]"), d.address,
+                   (unsigned long)d.transactions, d.failed, d.maxUs, d.quarantined);
+    if (n < 0 || len + n + 2 > size) return 0;
+    len += n;
+  }
+  payload[len++] = '}';
+  payload[len] = 0;
+  return len;
+}
+
+static void i2cHealthTask()
+{
+  unsigned long now = millis();
+  if (!reportRequested && (!i2cReportMs || now - lastReport < i2cReportMs)) return;
+  if (!mqttConnected) return;
+  size_t len = i2cHealthRender(mqttMessage, mqttMessageMax);
+  if (len && !mqttClient.publish(i2cHealthTopic, (const uint8_t*)mqttMessage, len)) return;
+  lastReport = now;
+  reportRequested = false;
+}
+
+void i2cBusBegin()
+{
+  i2cWireBegin();
+}
+
+void i2cHealthBegin()
+{
+  lastReport = millis();
+  taskManager.scheduleFixedRate(i2cTickMs, i2cHealthTask);
+}
@@ -0,0 +1,129 @@
+#include "latencyStats.h"
+#include "mqttConnection.h"
+#include "mqttEncoder.h"
+#include <TaskManagerIO.h>
+
+#define noLatencyEvent 0xFF
+
+struct LatencyHistogram
+{
+  uint16_t buckets[latencyBuckets];
+  uint32_t min;
+  uint32_t max;
+};
+
+static const char latencyStageNames[latencyStages][15] PROGMEM =
+  {"detect", "dispatch", "output", "persist", "publish", "press_to_light", "mqtt_to_light"};
+
+static LatencyHistogram histograms[latencyStages];
+
+static uint8_t eventStage = noLatencyEvent;
+static uint32_t eventOrigin;
+static uint32_t eventDispatchAt;
+
+static bool reportRequested = false;
+static bool resetRequested = false;
+static unsigned long lastReport = 0;
+
+static void latencyClear()
+{
+  memset(histograms, 0, sizeof(histograms));
+  for (uint8_t s = 0; s < latencyStages; s++) histograms[s].min = 0xFFFFFFFFUL;
+}
+
+void latencyRecord(uint8_t stage, uint32_t us)
+{
+  LatencyHistogram& h = histograms[stage];
+  uint8_t bucket = 0;
+  while (bucket < latencyBuckets - 1 && (us >> bucket)) bucket++;
+  if (h.buckets[bucket] == 0xFFFF)
+    for (uint8_t i = 0; i < latencyBuckets; i++) h.buckets[i] = (h.buckets[i] + 1) >> 1;
+  h.buckets[bucket]++;
+  if (us < h.min) h.min = us;
+  if (us > h.max) h.max = us;
+}
+
+void latencyEventBegin(uint8_t endToEnd, uint32_t origin)
+{
+  eventStage = endToEnd;
+  eventOrigin = origin;
+  eventDispatchAt = micros();
+}
+
+void latencyEventEnd()
+{
+  eventStage = noLatencyEvent;
+}
+
+void latencyLedsWritten(uint32_t flushAt)
+{
+  uint32_t now = micros();
+  latencyRecord(latencyOutput, now - flushAt);
+  if (eventStage == noLatencyEvent) return;
+  latencyRecord(latencyDispatch, flushAt - eventDispatchAt);
+  latencyRecord(eventStage, now - eventOrigin);
+  eventStage = noLatencyEvent;
+}
+
+// upper bound of the bucket holding the 99th percentile, within min..max
+static uint32_t latencyP99(const LatencyHistogram& h, uint32_t count)
+{
+  uint32_t rank = count - count / 100;
+  uint32_t seen = 0;
+  uint8_t bucket = 0;
+  for (; bucket < latencyBuckets - 1; bucket++)
+  {
+    seen += h.buckets[bucket];
+    if (seen >= rank) break;
+  }
+  uint32_t bound = bucket == latencyBuckets - 1 ? h.max : (1UL << bucket) - 1;
+  return bound < h.min ? h.min : bound > h.max ? h.max : bound;
+}
+
+size_t latencyRender(char* payload, size_t size)
+{
+  size_t len = 0;
+  payload[len++] = '{';
+  for (uint8_t s = 0; s < latencyStages; s++)
+  {
+    const LatencyHistogram& h = histograms[s];
+    uint32_t count = 0;
+    for (uint8_t i = 0; i < latencyBuckets; i++) count += h.buckets[i];
+    if (!count) continue;
+    char name[sizeof(latencyStageNames[0])];
+    strcpy_P(name, latencyStageNames[s]);
+    int n = snprintf_P(payload + len, size - len, PSTR("%s\"%s\":[%lu,%lu,%lu,%lu]"), len > 1 ? "," : "", name,
+                       (unsigned long)count, (unsigned long)h.min, (unsigned long)latencyP99(h, count), (unsigned long)h.max);
+    if (n < 0 || len + n + 2 > size) return 0;
+    len += n;
+  }
+  payload[len++] = '}';
+  payload[len] = 0;
+  return len;
+}
+
+static void latencyTask()
+{
+  unsigned long now = millis();
+  if (!reportRequested && (!latencyReportMs || now - lastReport < latencyReportMs)) return;
+  if (!mqttConnected) return;
+  size_t len = latencyRender(mqttMessage, mqttMessageMax);
+  if (len && !mqttClient.publish(latencyTopic, (const uint8_t*)mqttMessage, len)) return;
+  lastReport = now;
+  reportRequested = false;
+  if (resetRequested) latencyClear();
+  resetRequested = false;
+}
+
+void latencyRequestReport(bool reset)
+{
+  reportRequested = true;
+  resetRequested = resetRequested || reset;
+}
+
+void latencyBegin()
+{
+  latencyClear();
+  lastReport = millis();
+  taskManager.scheduleFixedRate(latencyTickMs, latencyTask);
+}
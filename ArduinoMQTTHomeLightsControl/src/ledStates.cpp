@@ -0,0 +1,100 @@
+#include "ledStates.h"
+#include "i2cBus.h"
+
+// PCF8574 outputs are high after power on
+uint8_t ledPorts[noOfOutputExpanders] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+const uint8_t ledAllMask[noOfOutputExpanders] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// outputs in use
+static uint8_t ledUsed[noOfOutputExpanders];
+// leds changed since the last ledStatesFlush()
+static uint8_t ledDirty[noOfOutputExpanders];
+// expanders whose last write failed, bit e
+static uint8_t ledUnwritten = 0;
+
+void ledEnable(uint8_t bit)
+{
+  if (bit >= noOfLedBits) return;
+  ledUsed[bit >> 3] |= 1 << (bit & 7);
+  ledDirty[bit >> 3] |= 1 << (bit & 7);   // written at least once, at the first flush
+}
+
+bool ledEnabled(uint8_t bit)
+{
+  return bit < noOfLedBits && (ledUsed[bit >> 3] & (1 << (bit & 7)));
+}
+
+void ledSet(uint8_t bit, uint8_t state)
+{
+  if (!ledEnabled(bit)) return;
+  uint8_t mask = 1 << (bit & 7);
+  uint8_t before = ledPorts[bit >> 3];
+  if (state) ledPorts[bit >> 3] |= mask;
+  else ledPorts[bit >> 3] &= ~mask;
+  ledDirty[bit >> 3] |= before ^ ledPorts[bit >> 3];
+}
+
+uint8_t ledToggle(uint8_t bit)
+{
+  if (!ledEnabled(bit)) return OFF;
+  uint8_t mask = 1 << (bit & 7);
+  ledPorts[bit >> 3] ^= mask;
+  ledDirty[bit >> 3] |= mask;
+  return ledGet(bit);
+}
+
+void ledSetMask(const uint8_t* mask, uint8_t state)
+{
+  for (uint8_t e = 0; e < noOfOutputExpanders; e++)
+  {
+    uint8_t before = ledPorts[e];
+    uint8_t m = mask[e] & ledUsed[e];
+    if (state) ledPorts[e] |= m;
+    else ledPorts[e] &= ~m;
+    ledDirty[e] |= before ^ ledPorts[e];
+  }
+}
+
+static int8_t hexDigit(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool ledMaskParse(const char* hex, uint8_t* mask)
+{
+  for (uint8_t e = 0; e < noOfOutputExpanders; e++)
+  {
+    int8_t hi = hexDigit(hex[2 * e]);
+    int8_t lo = hi < 0 ? -1 : hexDigit(hex[2 * e + 1]);
+    if (lo < 0) return false;
+    mask[e] = (hi << 4) | lo;
+  }
+  return hex[2 * noOfOutputExpanders] == 0;
+}
+
+static void ledWrite(uint8_t e)
+{
+  if (i2cWrite(outputExpanderAddress + e, ledPorts[e])) ledUnwritten &= ~(1 << e);
+  else ledUnwritten |= 1 << e;
+}
+
+void ledStatesFlush(uint8_t* changed)
+{
+  for (uint8_t e = 0; e < noOfOutputExpanders; e++)
+  {
+    if (changed) changed[e] = ledDirty[e];
+    if (!ledDirty[e]) continue;
+    ledWrite(e);
+    ledDirty[e] = 0;
+  }
+}
+
+void ledStatesRetry()
+{
+  for (uint8_t e = 0; ledUnwritten && e < noOfOutputExpanders; e++)
+    if (ledUnwritten & (1 << e)) ledWrite(e);
+}
@@ -0,0 +1,78 @@
+#include "ledTimers.h"
+#include "ledStates.h"
+#include <TaskManagerIO.h>
+
+#define noTimer 0xFF
+#define timerSlot(expiry) ((expiry) & (timerWheelSlots - 1))
+
+static uint8_t wheel[timerWheelSlots];       // first timer (led bit) of every slot
+static uint8_t timerNext[noOfLedBits];       // next timer in the same slot
+static uint16_t timerExpiry[noOfLedBits];
+static uint8_t timerArmed[noOfOutputExpanders];
+static uint16_t timerNow = 0;
+static uint16_t autoOffS[noOfLedBits];
+static void (*timersOnExpired)(const uint8_t* mask);
+
+bool ledTimerArmed(uint8_t bit)
+{
+  return bit < noOfLedBits && (timerArmed[bit >> 3] & (1 << (bit & 7)));
+}
+
+static void timerUnlink(uint8_t bit)
+{
+  uint8_t* link = &wheel[timerSlot(timerExpiry[bit])];
+  while (*link != bit) link = &timerNext[*link];
+  *link = timerNext[bit];
+  timerArmed[bit >> 3] &= ~(1 << (bit & 7));
+}
+
+void ledTimerStart(uint8_t bit, uint16_t seconds)
+{
+  if (bit >= noOfLedBits) return;
+  if (ledTimerArmed(bit)) timerUnlink(bit);
+  if (!seconds) return;
+  timerExpiry[bit] = timerNow + seconds;
+  uint8_t slot = timerSlot(timerExpiry[bit]);
+  timerNext[bit] = wheel[slot];
+  wheel[slot] = bit;
+  timerArmed[bit >> 3] |= 1 << (bit & 7);
+}
+
+void ledAutoOffSet(uint8_t bit, uint16_t seconds)
+{
+  if (bit < noOfLedBits) autoOffS[bit] = seconds;
+}
+
+uint16_t ledAutoOff(uint8_t bit)
+{
+  return bit < noOfLedBits ? autoOffS[bit] : 0;
+}
+
+static void ledTimersTask()
+{
+  timerNow++;
+  uint8_t expired[noOfOutputExpanders] = {0};
+  bool any = false;
+  uint8_t* link = &wheel[timerSlot(timerNow)];
+  while (*link != noTimer)
+  {
+    uint8_t bit = *link;
+    if (timerExpiry[bit] != timerNow)
+    {
+      link = &timerNext[bit];   // a later turn of the wheel
+      continue;
+    }
+    *link = timerNext[bit];
+    timerArmed[bit >> 3] &= ~(1 << (bit & 7));
+    expired[bit >> 3] |= 1 << (bit & 7);
+    any = true;
+  }
+  if (any) timersOnExpired(expired);
+}
+
+void ledTimersBegin(void (*onExpired)(const uint8_t* mask))
+{
+  timersOnExpired = onExpired;
+  memset(wheel, noTimer, sizeof(wheel));
+  taskManager.scheduleFixedRate(timerTickMs, ledTimersTask);
+}
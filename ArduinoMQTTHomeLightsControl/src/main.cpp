@@ -12,13 +12,13 @@ In my project I ise Arduino Mega pins + DIY boars containig 8 x PC8574A epanders
 Additionally I use 8 x PCF8574 epanders to achieve 64 OUTPUT PINS (called "leds" in the sketch). This is the maximum number of PCF8574(A) expanders that can be used.
 PINS can be reconfigured according to the need. 
 
-I'm using io-abstraction library to get all pins together.
+Up to 1.0 I used io-abstraction library to get all pins together.
 https://www.thecoderscorner.com/products/arduino-libraries/io-abstraction/
-Check MultiIoAbstraction for more details.
-https://www.thecoderscorner.com/products/arduino-libraries/io-abstraction/arduino-pins-and-io-expanders-same-time/
-Great library - many thanks to TheCodersCorner / Dave Cherry!
+Great library - many thanks to TheCodersCorner / Dave Cherry! Its task manager (TaskManagerIO) still runs everything in the background.
+Buttons are now read by buttonInputs (whole AVR ports and expander bytes at a time), leds are written by ledStates.
 
 State of leds is stored in EEPROM, so after the controler reset - the lights are back. EEPROM overrides initial states of light defined in the code.
+States are journaled (stateJournal): a short while after the last change a record of all leds is appended, spread over the whole EEPROM.
 You can erase EEPROM by pressing button 2 on Arduino.
 
 Configuration:
@@ -26,16 +26,17 @@ Configuration:
 2. Set up table of lights (called "leds") by entering there every light with it initial state (ON/OFF)
 3. Set up table of buttons and connection between buttons and leds by filling in table button2leds.
    Each row is on button, posision 0 defines button PIN number, next positions in a row define leds PIN numbers that should be 
-   switched by the button
+   switched by the button, vL ends the row
 4. REMARK: Do not use pins: 
     - 0,1, 4,5, 10, 13, 50,51,52,53 if using Ethernet shield 
     - analog IN 20,21 if using I2C expanders (for instance PCF8574)
     - PIN 2,3 and 6 are set up as special pins: 2 clears EEPROM, 3 turns off all leds, 6 does reset (to do). 
     This makes still 54 available PINs of Arduino Mega.
-5. I discovered strange behavior of the set up: if you want to use all the PINS of the PCF8574 Expander as outputs - you 
-   have to define one of PIN of each expander both as input and output. It still works then OK as Output. 
-   If you know the reason - please let me know.
-6. in the ioAbstraction.h - change #define MAX_ALLOWABLE_DELEGATES from 8 to 16
+5. Output expanders (PCF8574 0x20..0x27) are written directly, one I2C write per expander per event (ledStates),
+   so the old trick of defining one PIN of each output expander also as an input is no longer needed.
+6. Buttons (Arduino pins and input expanders PCF8574A 0x38..0x3F) are read by buttonInputs.
+   Wire the INT outputs of the input expanders together to PIN inputExpanderIntPin (for instance A15) and they are only
+   read when a button changes; without it they are polled every 20 ms.
 
 VERSION NOTES:
 
@@ -76,40 +77,69 @@ VERSION NOTES:
       - tested in production environment
 1.0.1 - Bugfixes and minor code improvement
       - Light conf adjustment  
+1.1.0 - Switching path performance
+      - button2leds indexed at boot (buttonMap), rows end with vL instead of fixed padding
+      - led states kept in a RAM bitmap (ledStates), one I2C write per output expander per event
+      - EEPROM state journal with wear levelling and delayed commit (stateJournal)
+      - all off / all on / masked switching as one transaction, also over MQTT (arduino01/led/set/all)
+      - state messages published without heap or JSON, topics and payloads from flash (mqttEncoder)
+      - two wildcard subscriptions instead of one per PIN, commands parsed in place (mqttRouter)
+      - MQTT connects in the background with backoff and reconnects after a broker restart (mqttConnection)
+      - state messages sent from a coalescing queue by a background task, not from the switching path (publishQueue)
+      - all leds in one message on arduino01/led/state_all, per led state topics can be turned off (publishLedTopics)
+      - Home Assistant discovery sent in the background and only for configs that changed (discovery), printed into
+        one static buffer instead of an ArduinoJson document on the stack
+      - input expanders read on their INT line (or polled), debounced 8 buttons at a time (buttonInputs)
+      - Arduino pin buttons scanned a whole port at a time, io-abstraction switches no longer used
+      - Serial messages buffered and sent in the background, filtered by logLevel at compile time (serialLog)
+      - latency histograms of every switching stage, published on arduino01/diag/latency (latencyStats)
+      - led and button names kept in flash (deviceRegistry), every button in buttons[] discovered
+      - watchdog; after a reset that kept the RAM the leds come back from a RAM snapshot at once (warmRestart)
+      - staged boot: leds and buttons first, Ethernet and MQTT afterwards in the background; stage times on arduino01/diag/boot (bootStages)
+      - local auto-off and hold-to-delay-off timers (ledTimers), auto-off times settable on arduino01/led/timer/<led>
+      - double/triple click and long press actions per button (buttonGestures), only those buttons wait for a second click
+      - I2C with timeouts, retries, bus recovery and quarantine of failing expanders, health on arduino01/diag/i2c (i2cBus)
+      - after a reconnect only what changed while disconnected is published, plus a slow background sweep (publishQueue)
+      - MQTT packets of one event batched into one socket write (batchClient)
+      - publish queue counters on arduino01/diag/counters (diagCounters)
 */
 
 
-#include <IoAbstraction.h>
-#include <IoAbstractionWire.h>
 #include <TaskManagerIO.h>
 #include <Wire.h>
 #include <Ethernet.h>
 #include <PubSubClient.h>
 #include <EEPROM.h>
 #include <string.h>
-#include <ArduinoJson.h>
-
-
-
-// Some areas of code shuld be compiled only in production - not in test mode
-#define prodMode 1
-
-//debug comments printed
-#define debugOn 1
-
-//debug MQTT comments printed
-#define mqttDebugOn 0
-
-#define buttonSetTopic "arduino01/button/set"
-#define buttonStateTopic "arduino01/button/state"
-#define ledSetTopic "arduino01/led/set"
-#define ledStateTopic "arduino01/led/state"
-
-//define ON/OFF for low triggered output PINs
-#define ON 0
-#define OFF 1
-#define ledsAutoDiscovery 1
-#define buttonsAutoDiscovery 1
+#include "homeLights.h"
+#include "buttonMap.h"
+#include "ledStates.h"
+#include "stateJournal.h"
+#include "mqttEncoder.h"
+#include "mqttRouter.h"
+#include "mqttConnection.h"
+#include "publishQueue.h"
+#include "discovery.h"
+#include "buttonInputs.h"
+#include "serialLog.h"
+#include "latencyStats.h"
+#include "deviceRegistry.h"
+#include "warmRestart.h"
+#include "bootStages.h"
+#include "ledTimers.h"
+#include "buttonGestures.h"
+#include "i2cBus.h"
+#include "batchClient.h"
+#include "diagCounters.h"
+
+
+// Serial messages go through serialLog, which messages are compiled is set by logLevel (serialLog.h)
+
+// Mega PIN with the INT lines of the input expanders (open drain, all 4 tied together), noIntPin to poll them.
+// Any free pin works (A15 = 69 is not a button here); 18 or 19 have an external interrupt, if they are not buttons.
+#ifndef inputExpanderIntPin
+#define inputExpanderIntPin noIntPin
+#endif
 
 //Setting up Ethernet shield
 byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xAD };
@@ -119,102 +149,93 @@ IPAddress mqttBrokerIp(192, 168, 1, 11); // MQTT broker IP adress
 #define mqttUser "homeassistant"
 #define mqttPasswd "aih1xo6oqueazeSa5oojootebo6Baj0aochizeThaighieghahdieBeco7phei7s"
 
-// no of PINS reserved for Arduino; first expander's PIN will start from EXPANDER1 value
-#define ArduinoPins 80
-#define startLedNo 160
-
 boolean mqttConnected = 0;
 
-// create a multi Io that allocates the first "#define ArduinoPins" pins to arduino pins
-MultiIoAbstractionRef multiIo = multiIoExpander(ArduinoPins);
+// the leds came back from the RAM snapshot (warmRestart.h)
+bool warmStart = false;
 
 EthernetClient ethClient;
-PubSubClient mqttClient(mqttBrokerIp, 1883, ethClient);
-
-struct led
-{ 
-  uint8_t ledNo;
-  boolean ledState;
-  boolean ledAutoDiscovery;
-  char ledName[14];
-};
+BatchClient mqttSocket(ethClient); // packets of one event leave as one socket write (batchClient.h)
+PubSubClient mqttClient(mqttBrokerIp, 1883, mqttSocket);
 
 //initiate table of leds (Expander PINS) - output. Max = 8x8=64 on PCF8574's
 //define initial state. Will be used if no EEPROM value found.
 //By default ledAutoDiscovery is set to 0. Change to 1 for leds that shoudl be visible in HomeAssistant.
-led leds[] = 
-  {  {startLedNo,OFF,1,"Antresola"}
-    ,{startLedNo+1,OFF,1,"Łaz. prysz."}
-    ,{startLedNo+2,OFF,1,"Krysia str."}
-    ,{startLedNo+3,OFF,1,"Krysia ref."}
-    ,{startLedNo+4,OFF,1,"Susz. sufit"}
-    ,{startLedNo+5,OFF,1,"Prac. sufit"}
-    ,{startLedNo+6,OFF,1,"Łaz. led"}                 
-    ,{startLedNo+7,OFF,1,"Susz. des."}
+//The table is kept in flash (deviceRegistry.h), the current state lives in ledPorts (ledStates.h).
+//The last value switches the led off after that many seconds on, 0 = never (ledTimers.h), also without MQTT.
+const LedEntry leds[] PROGMEM = 
+  {  {startLedNo,OFF,1,"Antresola",0}
+    ,{startLedNo+1,OFF,1,"Łaz. prysz.",0}
+    ,{startLedNo+2,OFF,1,"Krysia str.",0}
+    ,{startLedNo+3,OFF,1,"Krysia ref.",0}
+    ,{startLedNo+4,OFF,1,"Susz. sufit",0}
+    ,{startLedNo+5,OFF,1,"Prac. sufit",0}
+    ,{startLedNo+6,OFF,1,"Łaz. led",0}                 
+    ,{startLedNo+7,OFF,1,"Susz. des.",0}
     
-    ,{startLedNo+10,OFF,1,"Janek sam."}
-    ,{startLedNo+11,OFF,1,"Syp. EZ ref."}
-    ,{startLedNo+12,OFF,1,"Łaz. lustro"}
-    ,{startLedNo+13,OFF,1,"Syp. EZ suf."}
-    ,{startLedNo+14,OFF,1,"Krysia suf."}
-    ,{startLedNo+15,OFF,1,"Prac. biurka"}
-    ,{startLedNo+16,OFF,1,"Łaz. sufit"}
-    ,{startLedNo+17,OFF,1,"Janek ref."}
+    ,{startLedNo+10,OFF,1,"Janek sam.",0}
+    ,{startLedNo+11,OFF,1,"Syp. EZ ref.",0}
+    ,{startLedNo+12,OFF,1,"Łaz. lustro",0}
+    ,{startLedNo+13,OFF,1,"Syp. EZ suf.",0}
+    ,{startLedNo+14,OFF,1,"Krysia suf.",0}
+    ,{startLedNo+15,OFF,1,"Prac. biurka",0}
+    ,{startLedNo+16,OFF,1,"Łaz. sufit",0}
+    ,{startLedNo+17,OFF,1,"Janek ref.",0}
     
-    ,{startLedNo+20,OFF,1,"Led 20"}
-    ,{startLedNo+21,OFF,1,"Led 21"}
-    ,{startLedNo+22,OFF,1,"Gospodarcze"}
-    ,{startLedNo+23,OFF,1,"Hall duże"}
-    ,{startLedNo+24,OFF,1,"Jad. kwia.1"}
-    ,{startLedNo+25,OFF,1,"Led 25"}
-    ,{startLedNo+26,OFF,1,"Kuch. suf."}
-    ,{startLedNo+27,OFF,1,"Led 27"}
-
-    ,{startLedNo+30,OFF,1,"Led 30"}
-    ,{startLedNo+31,OFF,1,"Wejście"}
-    ,{startLedNo+32,OFF,1,"Hall wejście"}
-    ,{startLedNo+33,OFF,1,"Schody"}
-    ,{startLedNo+34,OFF,1,"Salon akw.L"}
-    ,{startLedNo+35,OFF,1,"Kuch. stół"}
-    ,{startLedNo+36,OFF,1,"Salon KL2"}
-    ,{startLedNo+37,OFF,1,"WC prysz."}
+    ,{startLedNo+20,OFF,1,"Led 20",0}
+    ,{startLedNo+21,OFF,1,"Led 21",0}
+    ,{startLedNo+22,OFF,1,"Gospodarcze",0}
+    ,{startLedNo+23,OFF,1,"Hall duże",0}
+    ,{startLedNo+24,OFF,1,"Jad. kwia.1",0}
+    ,{startLedNo+25,OFF,1,"Led 25",0}
+    ,{startLedNo+26,OFF,1,"Kuch. suf.",0}
+    ,{startLedNo+27,OFF,1,"Led 27",0}
+
+    ,{startLedNo+30,OFF,1,"Led 30",0}
+    ,{startLedNo+31,OFF,1,"Wejście",0}
+    ,{startLedNo+32,OFF,1,"Hall wejście",0}
+    ,{startLedNo+33,OFF,1,"Schody",300}
+    ,{startLedNo+34,OFF,1,"Salon akw.L",0}
+    ,{startLedNo+35,OFF,1,"Kuch. stół",0}
+    ,{startLedNo+36,OFF,1,"Salon KL2",0}
+    ,{startLedNo+37,OFF,1,"WC prysz.",0}
     
-    ,{startLedNo+40,OFF,1,"Salon suf."}
-    ,{startLedNo+41,OFF,1,"WC sufit"}
-    ,{startLedNo+42,OFF,1,"Garderoba"}
-    ,{startLedNo+43,OFF,0,"ERROR"}    // zewnętrzne
-    ,{startLedNo+44,OFF,1,"Led 44"}
-    ,{startLedNo+45,OFF,1,"Taras bok"}
-    ,{startLedNo+46,OFF,1,"Wej.gosp."}
-    ,{startLedNo+47,OFF,1,"Taras las"}
+    ,{startLedNo+40,OFF,1,"Salon suf.",0}
+    ,{startLedNo+41,OFF,1,"WC sufit",900}
+    ,{startLedNo+42,OFF,1,"Garderoba",600}
+    ,{startLedNo+43,OFF,0,"ERROR",0}    // zewnętrzne
+    ,{startLedNo+44,OFF,1,"Led 44",0}
+    ,{startLedNo+45,OFF,1,"Taras bok",0}
+    ,{startLedNo+46,OFF,1,"Wej.gosp.",0}
+    ,{startLedNo+47,OFF,1,"Taras las",0}
     
-    ,{startLedNo+50,OFF,1,"Salon KL1"}
-    ,{startLedNo+51,OFF,1,"WC lustro"}
-    ,{startLedNo+52,OFF,1,"TV kin.tył"}
-    ,{startLedNo+53,OFF,1,"Salon KP2"}
-    ,{startLedNo+54,OFF,1,"TV sufit"}
-    ,{startLedNo+55,OFF,1,"Salon KP1"}
-    ,{startLedNo+56,OFF,1,"Kuch. zlew"}
-    ,{startLedNo+57,OFF,1,"Jad. kwia.2"}
+    ,{startLedNo+50,OFF,1,"Salon KL1",0}
+    ,{startLedNo+51,OFF,1,"WC lustro",0}
+    ,{startLedNo+52,OFF,1,"TV kin.tył",0}
+    ,{startLedNo+53,OFF,1,"Salon KP2",0}
+    ,{startLedNo+54,OFF,1,"TV sufit",0}
+    ,{startLedNo+55,OFF,1,"Salon KP1",0}
+    ,{startLedNo+56,OFF,1,"Kuch. zlew",0}
+    ,{startLedNo+57,OFF,1,"Jad. kwia.2",0}
     
-    ,{startLedNo+60,OFF,0,"Kuch. blat"}
-    ,{startLedNo+61,OFF,0,"Salon akw.P"}
-    ,{startLedNo+62,OFF,0,"Salon buda"}
-    ,{startLedNo+63,OFF,0,"Jad. stół"}
-    ,{startLedNo+64,OFF,0,"TV kin.przód"}
-    ,{startLedNo+65,OFF,0,"Led 65"}
-    ,{startLedNo+66,OFF,0,"Led 66"}
-    ,{startLedNo+67,OFF,0,"Led 67"}
+    ,{startLedNo+60,OFF,0,"Kuch. blat",0}
+    ,{startLedNo+61,OFF,0,"Salon akw.P",0}
+    ,{startLedNo+62,OFF,0,"Salon buda",0}
+    ,{startLedNo+63,OFF,0,"Jad. stół",0}
+    ,{startLedNo+64,OFF,0,"TV kin.przód",0}
+    ,{startLedNo+65,OFF,0,"Led 65",0}
+    ,{startLedNo+66,OFF,0,"Led 66",0}
+    ,{startLedNo+67,OFF,0,"Led 67",0}
     
     /*
-    ,{startLedNo+70,OFF,0,"Led 70"}
-    ,{startLedNo+71,OFF,0,"Led 71"}
-    ,{startLedNo+72,OFF,0,"Led 72"}
-    ,{startLedNo+73,OFF,0,"Led 73"}
-    ,{startLedNo+74,OFF,0,"Led 74"}
-    ,{startLedNo+75,OFF,0,"Led 75"}
-    ,{startLedNo+76,OFF,0,"Led 76"}
-    ,{startLedNo+77,OFF,0,"Led 77"}
+    ,{startLedNo+70,OFF,0,"Led 70",0}
+    ,{startLedNo+71,OFF,0,"Led 71",0}
+    ,{startLedNo+72,OFF,0,"Led 72",0}
+    ,{startLedNo+73,OFF,0,"Led 73",0}
+    ,{startLedNo+74,OFF,0,"Led 74",0}
+    ,{startLedNo+75,OFF,0,"Led 75",0}
+    ,{startLedNo+76,OFF,0,"Led 76",0}
+    ,{startLedNo+77,OFF,0,"Led 77",0}
     */
   };
 
@@ -223,151 +244,134 @@ size_t noOfLeds = sizeof(leds) / sizeof(leds[0]);
 
 uint8_t currentEEPROMValue=250;
 
-//this is the number of leds that can be mananaged by single button
-#define maxNoOfLedsPerButton 5
-
-/* Define which buttons control which leds. First number in a row is a button PIN number, then come leds PIN numbers.
-Please make sure to add line for EACH ADDED eapander:
-  {100,vL,vL,vL,vL,vL},
-where 100 should be replaced by one of expander's pins.
-independently you can define this PIN as output.
-Without this trick Outputs on the expander don't work ;)
+/* Define which buttons control which leds. First number in a row is a button PIN number, then come leds PIN numbers,
+the row ends with vL. A button can switch any number of leds (up to maxButtonLedLinks in total for all buttons).
+The table is indexed once at boot (buttonMapBuild), so it can be kept in any order.
 */
 
-// vL - voidLed - number representing no led assigned
-#define vL 255
-
-const uint8_t  button2leds[][maxNoOfLedsPerButton+1] PROGMEM = 
-  { {2,vL,vL,vL,vL,vL}, //this one clears EEPROM
-    {3,vL,vL,vL,vL,vL}, //this one to turn all off
-    {6,vL,vL,vL,vL,vL}, //this one is wired do reset
-    {7,32,vL,vL,vL,vL},  //P0 Kitchen 1
-    {8,5,vL,vL,vL,vL},   //P1 Office room 1
-    {9,54,vL,vL,vL,vL},  //P0 TV 4
-    {11,54,vL,vL,vL,vL},  //P0 TV 3
-    {12,15,vL,vL,vL,vL},  //P1 Office room 2
-    {14,26,vL,vL,vL,vL},  //P0 Kitchen 3
-    {15,35,vL,vL,vL,vL},  //P0 Kitchen 4
+const uint8_t  button2leds[] PROGMEM = 
+  { 2, vL, //this one clears EEPROM
+    3, vL, //this one to turn all off
+    6, vL, //this one is wired do reset
+    7, 32, vL,  //P0 Kitchen 1
+    8, 5, vL,   //P1 Office room 1
+    9, 54, vL,  //P0 TV 4
+    11, 54, vL,  //P0 TV 3
+    12, 15, vL,  //P1 Office room 2
+    14, 26, vL,  //P0 Kitchen 3
+    15, 35, vL,  //P0 Kitchen 4
     
-    {16,51,vL,vL,vL,vL},  //P0 WC2
-    {17,40,vL,vL,vL,vL},  //P0 Salon 3
-    {18,64,vL,vL,vL,vL},  //P0 TV 1
-    {19,41,vL,vL,vL,vL},  //P0 WC 1
-    {22,45,vL,vL,vL,vL},  //P0 Dining N1
-    {23,52,vL,vL,vL,vL},  //P0 TV blinds 2
-    {24,47,vL,vL,vL,vL},  //P0 Dining N2
-    {25,64,vL,vL,vL,vL},  //P0 TV blinds 1
-    {26,16,vL,vL,vL,vL},  //P1 Antresola bathroom 1
-    {27,23,vL,vL,vL,vL},  //P0 Kitchen 2
+    16, 51, vL,  //P0 WC2
+    17, 40, vL,  //P0 Salon 3
+    18, 64, vL,  //P0 TV 1
+    19, 41, vL,  //P0 WC 1
+    22, 45, vL,  //P0 Dining N1
+    23, 52, vL,  //P0 TV blinds 2
+    24, 47, vL,  //P0 Dining N2
+    25, 64, vL,  //P0 TV blinds 1
+    26, 16, vL,  //P1 Antresola bathroom 1
+    27, 23, vL,  //P0 Kitchen 2
     
-    {28,13,vL,vL,vL,vL},  //P1 SypEZ 1
-    {29,vL,vL,vL,vL,vL},  //P0 Hall 5                         
-    {30,02,vL,vL,vL,vL},  //P1 Krysia 3 (dupl. strych)
-    {31,54,vL,vL,vL,vL},  //P0 TV blinds 3
-    {32,54,vL,vL,vL,vL},  //P0 TV blinds 4
-    {33,33,vL,vL,vL,vL},  //P0 stairs 1
-    {34,36,50,vL,vL,vL},  //P0 Salon 1
-    {35,31,vL,vL,vL,vL},  //P0 Hall 1
-    {36,vL,vL,vL,vL,vL},  //P0 Hall 2                        
-    {37,34,61,62,vL,vL},  //P0 Salon 7
+    28, 13, vL,  //P1 SypEZ 1
+    29, vL,  //P0 Hall 5                         
+    30, 02, vL,  //P1 Krysia 3 (dupl. strych)
+    31, 54, vL,  //P0 TV blinds 3
+    32, 54, vL,  //P0 TV blinds 4
+    33, 33, vL,  //P0 stairs 1
+    34, 36, 50, vL,  //P0 Salon 1
+    35, 31, vL,  //P0 Hall 1
+    36, vL,  //P0 Hall 2                        
+    37, 34, 61, 62, vL,  //P0 Salon 7
     
-    {38,40,vL,vL,vL,vL},  //P0 Salon 4
-    {39,46,vL,vL,vL,vL},  //P0 gosp drzwi 1
-    {40,51,vL,vL,vL,vL},  //P0 WC mirror 
-    {41,34,61,62,vL,vL},  //P0 Dining N6
-    {42,40,vL,vL,vL,vL},  //P0 Dining N5
-    {43,42,vL,vL,vL,vL},  //P0 Wardrobe 2
-    {44,32,vL,vL,vL,vL},  //P0 Hall 3 
-    {45,0,vL,vL,vL,vL},   //P1 Antresola SypEZ 2                        
-    {46,63,vL,vL,vL,vL},  //P0 Dining N4
-    {47,22,vL,vL,vL,vL},   //P1 gosp door 2
+    38, 40, vL,  //P0 Salon 4
+    39, 46, vL,  //P0 gosp drzwi 1
+    40, 51, vL,  //P0 WC mirror 
+    41, 34, 61, 62, vL,  //P0 Dining N6
+    42, 40, vL,  //P0 Dining N5
+    43, 42, vL,  //P0 Wardrobe 2
+    44, 32, vL,  //P0 Hall 3 
+    45, 0, vL,   //P1 Antresola SypEZ 2                        
+    46, 63, vL,  //P0 Dining N4
+    47, 22, vL,   //P1 gosp door 2
     
-    {48,40,vL,vL,vL,vL},        //P1 Antresola Janek 4  
-    {49,vL,vL,vL,vL,vL},        //P1 Krysia 4
-    {54,53,55,vL,vL,vL}, //A0   //P0 Salon 2
-    {55,vL,vL,vL,vL,vL}, //A1
-    {56,37,vL,vL,vL,vL}, //A2   //P0 WC shower
-    {57,vL,vL,vL,vL,vL}, //A3
-    {58,vL,vL,vL,vL,vL}, //A4
-    {59,vL,vL,vL,vL,vL}, //A5
-    {60,vL,vL,vL,vL,vL}, //A6
-    {61,vL,vL,vL,vL,vL}, //A7
+    48, 40, vL,        //P1 Antresola Janek 4  
+    49, vL,        //P1 Krysia 4
+    54, 53, 55, vL, //A0   //P0 Salon 2
+    55, vL, //A1
+    56, 37, vL, //A2   //P0 WC shower
+    57, vL, //A3
+    58, vL, //A4
+    59, vL, //A5
+    60, vL, //A6
+    61, vL, //A7
     
-    {62,vL,vL,vL,vL,vL}, //A8
-    {63,vL,vL,vL,vL,vL}, //A9
-    {64,vL,vL,vL,vL,vL}, //A10
-    {65,vL,vL,vL,vL,vL}, //A11
-    {66,vL,vL,vL,vL,vL}, //A12
-    {67,vL,vL,vL,vL,vL}, //A13
-    {68,vL,vL,vL,vL,vL}, //A14
+    62, vL, //A8
+    63, vL, //A9
+    64, vL, //A10
+    65, vL, //A11
+    66, vL, //A12
+    67, vL, //A13
+    68, vL, //A14
     //Here starts the expander 0x38
-    {80,0,vL,vL,vL,vL},  //P1 Antresola Janek 2      
-    {81,vL,vL,vL,vL,vL},  //P0 Hall 6                  
-    {82,24,57,vL,vL,vL},  //P0 Dining W3
-    {83,60,vL,vL,vL,vL},  //P0 Kitchen 6
-    {84,17,vL,vL,vL,vL},  //P1 Janek 2
-    {85,63,vL,vL,vL,vL},  //P0 Dining W4
-    {86,10,vL,vL,vL,vL},  //P1 Janek 1
-    {87,0,vL,vL,vL,vL},  //P0 Stairs down 2
+    80, 0, vL,  //P1 Antresola Janek 2      
+    81, vL,  //P0 Hall 6                  
+    82, 24, 57, vL,  //P0 Dining W3
+    83, 60, vL,  //P0 Kitchen 6
+    84, 17, vL,  //P1 Janek 2
+    85, 63, vL,  //P0 Dining W4
+    86, 10, vL,  //P1 Janek 1
+    87, 0, vL,  //P0 Stairs down 2
     //Here starts the expander 0x3A
-    {100,47,vL,vL,vL,vL},  //P0 Dining W2   
-    {101,11,vL,vL,vL,vL},  //P1 SypEZ 2
-    {102,vL,vL,vL,vL,vL},  //NN
-    {103,52,vL,vL,vL,vL},  //P0 TV 2
-    {104,3,vL,vL,vL,vL},   //P1 Krysia 2
-    {105,23,vL,vL,vL,vL},  //P0 Hall 4                                 
-    {106,24,57,vL,vL,vL},  //P0 Dining N3
-    {107,25,vL,vL,vL,vL},  //P0 Hall 7
+    100, 47, vL,  //P0 Dining W2   
+    101, 11, vL,  //P1 SypEZ 2
+    102, vL,  //NN
+    103, 52, vL,  //P0 TV 2
+    104, 3, vL,   //P1 Krysia 2
+    105, 23, vL,  //P0 Hall 4                                 
+    106, 24, 57, vL,  //P0 Dining N3
+    107, 25, vL,  //P0 Hall 7
     //Here starts the expander 0x3C
-    {120,vL,vL,vL,vL,vL},  //P0 Hall 8 - all off   
-    {121,vL,vL,vL,vL,vL},  //NN
-    {122,33,vL,vL,vL,vL},  //P1 Antresola Janek 1
-    {123,45,vL,vL,vL,vL},  //P0 Dining W1  
-    {124,6,vL,vL,vL,vL},  //P1 Antresola bathroom 2   -  ledy nocne
-    {125,22,vL,vL,vL,vL},  //P0 gosp 2                                 
-    {126,4,vL,vL,vL,vL},  //P1 Washroom 2
-    {127,vL,vL,vL,vL,vL},  //NC - no cable
+    120, vL,  //P0 Hall 8 - all off   
+    121, vL,  //NN
+    122, 33, vL,  //P1 Antresola Janek 1
+    123, 45, vL,  //P0 Dining W1  
+    124, 6, vL,  //P1 Antresola bathroom 2   -  ledy nocne
+    125, 22, vL,  //P0 gosp 2                                 
+    126, 4, vL,  //P1 Washroom 2
+    127, vL,  //NC - no cable
     //Here starts the expander 0x3E
-    {140,14,vL,vL,vL,vL},  //P1 Krysia 1   
-    {141,42,vL,vL,vL,vL},  //P0 Wardrobe 1
-    {142,56,vL,vL,vL,vL},  //P0 Kitchen 5
-    {143,12,vL,vL,vL,vL},   //P1 bathroom 1
-    {144,42,vL,vL,vL,vL},  //P0 gosp 1                                  
-    {145,7,vL,vL,vL,vL},  //P1 Washroom 1
-    {146,40,vL,vL,vL,vL},  //P1 Antresola Janek 3
-    {147,1,vL,vL,vL,vL},  //P1 bathroom 2
-    //Fake INPUT pins which are going to be redefined to OUTPUTS in the next step. 
-    //Without this trick - ioAbstraction expanders don't work (at least at my place)
-    {startLedNo,vL,vL,vL,vL,vL}, //to make outputs on expander 0x20 work
-    {startLedNo+10,vL,vL,vL,vL,vL},  //to make outputs on expander 0x21 work
-    {startLedNo+20,vL,vL,vL,vL,vL}, //to make outputs on expander 0x22 work
-    {startLedNo+30,vL,vL,vL,vL,vL},  //to make outputs on expander 0x23 work
-    {startLedNo+40,vL,vL,vL,vL,vL}, //to make outputs on expander 0x24 work
-    {startLedNo+50,vL,vL,vL,vL,vL},  //to make outputs on expander 0x25 work
-    {startLedNo+60,vL,vL,vL,vL,vL}, //to make outputs on expander 0x25 work
-    {startLedNo+70,vL,vL,vL,vL,vL}  //to make outputs on expander 0x25 work
-    
+    140, 14, vL,  //P1 Krysia 1   
+    141, 42, vL,  //P0 Wardrobe 1
+    142, 56, vL,  //P0 Kitchen 5
+    143, 12, vL,   //P1 bathroom 1
+    144, 42, vL,  //P0 gosp 1                                  
+    145, 7, vL,  //P1 Washroom 1
+    146, 40, vL,  //P1 Antresola Janek 3
+    147, 1, vL,  //P1 bathroom 2
   };
 
-//count the number of buttons
-size_t noOfButtons = sizeof(button2leds) / sizeof(button2leds[0]);
-
-struct button
-{ 
-  int16_t buttonNo;
-  boolean buttonAutoDiscovery;
-  char buttonName[20];
-};
-
+// Buttons whose hold switches their leds on and off again holdDelayOffS later (leaving a room or the stairs);
+// holding other buttons toggles their leds once more. The list ends with vL.
+#define holdDelayOffS 60
+const uint8_t holdDelayOffButtons[] PROGMEM = { 33, 35, vL };
+
+// Gesture actions (buttonGestures.h): button PIN number, gesture, action, then the leds (as in button2leds), vL.
+// Only buttons with a gestureDouble or gestureTriple row wait gestureClickGapMs after a click to see if another
+// follows; gestures without a row do what the button did before (its leds toggled per click, the hold behaviour).
+const uint8_t gestureActions[] PROGMEM =
+  { 34, gestureDouble, gestureToggle, 34, 36, 40, 50, 53, 55, 61, 62, vL,  //P0 Salon 1: the whole salon
+    44, gestureLong, gestureOff, 22, 23, 24, 26, 31, 32, 33, 34, 35, 36, 37, 40, 41, 42, 46,
+                                 50, 51, 52, 53, 54, 55, 56, 57, 60, 61, 62, 63, 64, vL,  //P0 Hall 3: ground floor off, terraces stay
+  };
 
 // Should a button be auto discovered via mqtt - add a row with the number, then "1" and the name
-// change 1 to 0 if you want to remove from auto discovery
-button buttons[] = 
+// change 1 to 0 if you want to remove from auto discovery. Buttons without a row in button2leds are not discovered.
+// The table is kept in flash (deviceRegistry.h).
+const ButtonEntry buttons[] PROGMEM = 
 {
   {2,1,"CLR EEPROM"},
   {3,1,"All Leds OFF"},
 
-/*
   {35,1,"Hall 1"},  
   {36,1,"Hall 2"},  
   //Hall 3 not working
@@ -460,281 +464,205 @@ button buttons[] =
   {104,1,"Krysia 2"},
   {156,1,"Krysia 3"},
   {154,1,"Krysia 4"},
-
-*/
-  
 };
 
 size_t noOfButtons2 = sizeof(buttons) / sizeof(buttons[0]);
 
 void clearEeprom()
 {
-  for (size_t i = 0; i < noOfLeds; ++i) 
-    {
-      EEPROM.write(i, -1);
-    }
-    Serial.println ("EEPROM Cleared");
-}
-
-void serialPrintEeprom()
-{
-   for (size_t i = 0; i < noOfLeds; ++i) 
-    {
-      Serial.print(leds[i].ledNo);
-      Serial.print(" = ");
-      Serial.println(EEPROM.read(i));
-    }
+    journalClear();
+    warmRestartClear(); // a reset now also starts from the init states
+    logInfo("EEPROM Cleared");
 }
 
-void saveLedStatesToEeprom(uint8_t switchedLed, uint8_t ledState)
+// Home Assistant discovery config no entity: buttons[] first, then leds[] (see discovery.h).
+// The JSON is printed straight into payload (mqttMessage); names go in as they are, so no quotes or backslashes in them.
+uint16_t discoveryConfig(uint16_t entity, uint8_t* key, char* topic, char* payload)
 {
-  for (size_t i=0; i<noOfLeds; i++)
+  boolean turnON;
+  int length = 0;
+  if (entity >= noOfButtons2)
   {
-    if (leds[i].ledNo == switchedLed)
-    {
-      leds[i].ledState = ledState;
-    } 
-    EEPROM.update(i,leds[i].ledState);
+    LedEntry l;       // RAM copy of the registry entry
+    registryLed(entity - noOfButtons2, l);
+    *key = l.ledNo;
+    turnON = l.ledAutoDiscovery;
+    snprintf_P(topic, discoveryTopicMax, PSTR("homeassistant/light/light_%u/config"), *key);
+    if (turnON)
+      length = snprintf_P(payload, discoveryPayloadMax, PSTR("{\"platform\":\"mqtt\",\"schema\":\"template\","
+        "\"uniq_id\":\"led_%u\",\"name\":\"%s\",\"cmd_t\":\"" ledSetTopic "/%u\",\"stat_t\":\"" ledStateTopic "/%u\","
+        "\"cmd_on_tpl\":\"{\\\"state\\\":\\\"on\\\"}\",\"cmd_off_tpl\":\"{\\\"state\\\":\\\"off\\\"}\","
+        "\"stat_tpl\":\"{{ value_json.state }}\",\"qos\":\"1\",\"retain\":\"FALSE\"}"), *key, l.ledName, *key, *key);
   }
-  
+  else
+  {
+    ButtonEntry btn;
+    registryButton(entity, btn);
+    *key = btn.buttonNo;
+    turnON = btn.buttonAutoDiscovery && buttonConfigured(btn.buttonNo); // commands for other PINs are dropped
+    snprintf_P(topic, discoveryTopicMax, PSTR("homeassistant/button/button_%u/config"), *key);
+    if (turnON)
+      length = snprintf_P(payload, discoveryPayloadMax, PSTR("{\"platform\":\"mqtt\",\"uniq_id\":\"button_%u\",\"name\":\"%s\","
+        "\"cmd_t\":\"" buttonSetTopic "/%u\",\"payload_press\":\"{\\\"state\\\":\\\"pressed\\\"}\","
+        "\"qos\":\"1\",\"retain\":\"FALSE\"}"), *key, btn.buttonName, *key);
+  }
+  if (!turnON || length < 0) 
+  {
+    payload[0] = 0;  // empty retained config removes the entity
+    return 0;
+  }
+  return length < discoveryPayloadMax ? length : discoveryPayloadMax - 1;
 }
 
-void onSwitchPressed(uint8_t key, bool held); //just the declaration here
 
-//Connect to MQTT broker
-boolean mqttConnect() 
+
+// Finish an event that changed leds: one expander flush, one journal note and the changed leds queued for publishing.
+// Returns the number of changed leds.
+uint8_t ledsCommit()
 {
-  uint8_t count=0;
-  int waitTime=2000;
-  while (!mqttClient.connected() && count<5) 
+  uint8_t changed[noOfOutputExpanders];
+  uint8_t noOfChanged = 0;
+  uint32_t flushAt = micros();
+  ledStatesFlush(changed);
+  latencyLedsWritten(flushAt);
+  for (uint8_t e=0; e<noOfOutputExpanders; e++)
   {
-    Serial.print("Attempting MQTT connection...");
-    // Attempt to connect (5 times - each time wait 2 seconds longer than before)
-    if (mqttClient.connect("arduinoClient", mqttUser, mqttPasswd)) 
+    if (!changed[e]) continue;
+    for (uint8_t b=0; b<8; b++)
     {
-      Serial.println("Connected");
-    } else 
-      {
-        Serial.print("failed, rc=");
-        Serial.print(mqttClient.state());
-        Serial.println(" try again in 2 seconds");
-        count++;
-        // wait 2 seconds to repeat
-        delay(count*waitTime);
-      }
+      if (!(changed[e] & (1 << b))) continue;
+      noOfChanged++;
+      uint8_t bit = e*8+b;
+      ledTimerStart(bit, ledGet(bit) == ON ? ledAutoOff(bit) : 0); // auto-off armed when on, cancelled when off
+      logDebug("Led no: %u %s", ledBitToNo(bit), ledGet(bit) ? "OFF" : "ON");
+    }
   }
-  if (count < 5) 
+  if (noOfChanged)
   {
-    return 1;
-  }
-  else
-  { 
-    Serial.println("MQTT Connection failed. Arduino only mode.");
-    return 0;
+    warmRestartSave(ledPorts);
+    publishLeds(changed);
+    journalNoteChange();
   }
-    
+  return noOfChanged;
 }
 
-//subsribe to topic constructed of topic/key
-int8_t mqttSubscribeToTopic(String topic, uint16_t key)
+// Switch a set of leds (mask laid out like ledPorts, see ledStates.h) to state as one transaction
+uint8_t ledsApply(const uint8_t* mask, uint8_t state)
 {
-  String keyStr = String(key).c_str();
-  char topicChar[50] = {"\0"};
-  String topicStr = topic;
-  topicStr = topicStr + "/" + keyStr;
-  topicStr.toCharArray(topicChar,topicStr.length()+1);
-  int8_t subscribeResult = mqttClient.subscribe(topicChar);
-  #if mqttDebugOn
-  {
-    Serial.print("Subscribed to topic: ");
-    Serial.print(topicChar);
-    Serial.print(" with the result: ");
-    Serial.println(subscribeResult);
-  }
-  #endif
-  return  subscribeResult;
+  ledSetMask(mask, state);
+  return ledsCommit();
 }
 
-// Publish keyState as payload to MQTT topic named topic/key
-void mqttPublishState(String topic, uint16_t key, uint8_t keyState)
-{ 
-  //DynamicJsonDocument doc(1024);
-  StaticJsonDocument<512> doc;
-  String keyStr = String(key).c_str();
-  //Serial.print("Key in mqqPublish = ");
-  //Serial.println(key);
-  if (key>=startLedNo)
-  {   //Serial.println("I'm in if");
-      doc["state"] = keyState ? "off" : "on";
-      //Serial.print("keyState = ");
-      //Serial.println(keyState);    
-      //doc1["brightness"] = 255;
-  }
-  else
-  {
-      doc["state"] = keyState ? "held_down" : "pressed";
-  }
-  //Serial.print("Before serialize ");
-  //Serial.print("doc[state] = ");
-  //Serial.println((char*)doc["state"]);
-  char topicChar[50] = {"\0"};
-  String topicStr = String(topic).c_str();  
-  topicStr = topicStr + "/" + keyStr;
-  topicStr.toCharArray(topicChar,topicStr.length()+1);
-  char payloadChar[512] = {"\0"};
-  //int b = 
-  serializeJson(doc, payloadChar);
-  //Serial.print("bytes = ");
-  //Serial.println(b,DEC);
-  //Serial.print("After serialize ");
-  //Serial.print("doc[state] = ");
-  //Serial.println((char*)doc["state"]);
-  #if mqttDebug
-  boolean publishResult = 
-  #endif
-  mqttClient.publish(topicChar, payloadChar, true);  
-  //Serial.print("payloadChar = ");
-  //Serial.println(payloadChar);
-  
-  #if mqttDebugOn
-    Serial.print("Published message: ");
-    Serial.println(payloadChar);
-
-    Serial.print(" to topic: ");
-    Serial.print(topicStr);
-    Serial.print(" with the result: ");
-    Serial.println(publishResult);
-  #endif
+// leds whose auto-off or delayed off timer ran out (ledTimers.h)
+void onLedTimersExpired(const uint8_t* mask)
+{
+  ledsApply(mask, OFF);
 }
 
+bool holdDelaysOff(uint8_t key)
+{
+  for (const uint8_t* p = holdDelayOffButtons; pgm_read_byte(p) != vL; p++)
+    if (pgm_read_byte(p) == key) return true;
+  return false;
+}
 
-void mqttSendAutoDiscovery(int16_t key, boolean turnON)
-{   
-  //DynamicJsonDocument doc(1024);
-  StaticJsonDocument<512> doc;
-  String keyStr = String(key).c_str();
-  String topicStr;
-  String slash = "/";
-  if (key>=startLedNo)
-  {
-    doc["platform"] = "mqtt";
-    doc["schema"] = "template";
-    doc["uniq_id"] = "led_"+ keyStr;
-    for (uint8_t i=0; i<noOfLeds; i++)
-    {
-      if (leds[i].ledNo == key) doc["name"] = leds[i].ledName;  
-    }
-    doc["cmd_t"] = ledSetTopic + slash + keyStr;
-    doc["stat_t"] = ledStateTopic + slash + keyStr;
-    doc["cmd_on_tpl"] = "{\"state\":\"on\"}";
-    doc["cmd_off_tpl"] = "{\"state\":\"off\"}";
-    doc["stat_tpl"] = "{{ value_json.state }}";
-    doc["qos"] = "1";
-    doc["retain"] = "FALSE";
-    topicStr = "homeassistant/light/light_" + keyStr +"/config";
-  }
-  else
-  {
-    doc["platform"] = "mqtt";
-    doc["uniq_id"] = "button_"+keyStr;
-    doc["name"] = "Button Name";
-    for (uint8_t i=0; i<noOfButtons2; i++)
-    {
-      if (buttons[i].buttonNo == key) doc["name"] = buttons[i].buttonName;  
-    }
-    doc["cmd_t"] = buttonSetTopic + slash + keyStr;
-    doc["payload_press"] = "{\"state\":\"pressed\"}";
-    doc["qos"] = "1";
-    doc["retain"] = "FALSE";
-    topicStr = "homeassistant/button/button_" + keyStr +"/config";
-  }
+// "state" of a led command payload: ON, OFF or vL if missing or not understood
+uint8_t ledPayloadState(const byte* payload, unsigned int length)
+{
+  char state[8];
+  if (!mqttPayloadValue(payload, length, "state", state, sizeof(state))) return vL;
+  if (!strcmp(state, "1") || !strcmp(state, "ON") || !strcmp(state, "on")) return ON;
+  if (!strcmp(state, "0") || !strcmp(state, "OFF") || !strcmp(state, "off")) return OFF;
+  return vL;
+}
 
-  char topicChar[50] = {"\0"};
-  topicStr.toCharArray(topicChar,topicStr.length()+1);
-  char payloadChar[512] = {"\0"};
-  int b = 0;
-  if (turnON) 
-  {
-    b = serializeJson(doc, payloadChar);
-  }
-  #if mqttDebugOn
-  boolean publishResult = 
-  #endif
-  mqttClient.publish(topicChar, payloadChar, true);
-  #if mqttDebugOn
-    Serial.print("Published message: ");
-    Serial.println(payloadChar);
-    Serial.print(" to topic: ");
-    Serial.print(topicStr);
-    Serial.print(" with the result: ");
-    Serial.println(publishResult);
-  #endif
+// buttonSetTopic/key
+void onMqttButtonSet(uint8_t key, const byte* payload, unsigned int length)
+{
+  char state[16];
+  if (!mqttPayloadValue(payload, length, "state", state, sizeof(state))) return;
+  uint8_t gesture;
+  if (!strcmp(state, "0") || !strcmp(state, "pressed")) gesture = gestureSingle;
+  else if (!strcmp(state, "1") || !strcmp(state, "hold_down")) gesture = gestureLong;
+  else if (!strcmp(state, "double_click")) gesture = gestureDouble;
+  else if (!strcmp(state, "triple_click")) gesture = gestureTriple;
+  else return;
+  onGesture(key, gesture);
+  logDebug("Button %s by MQTT message", state);
 }
 
+// ledSetTopic/ledNo
+void onMqttLedSet(uint8_t ledNo, const byte* payload, unsigned int length)
+{
+  uint8_t state = ledPayloadState(payload, length);
+  if (state == vL) return;
+  ledSet(ledBit(ledNo), state);
+  if (!ledsCommit()) publishLed(ledBit(ledNo)); // confirm even if nothing changed
+  logDebug("Led turned %s by MQTT message", state == ON ? "on" : "off");
+}
 
+// ledSetTopic/all
+void onMqttLedSetAll(uint8_t, const byte* payload, unsigned int length)
+{
+  uint8_t mask[noOfOutputExpanders];
+  char payloadMask[2 * noOfOutputExpanders + 1];
+  uint8_t state = ledPayloadState(payload, length);
+  if (state == vL) return;
+  if (!mqttPayloadValue(payload, length, "mask", payloadMask, sizeof(payloadMask))) memcpy(mask, ledAllMask, sizeof(mask));
+  else if (!ledMaskParse(payloadMask, mask)) return;
+  ledsApply(mask, state);
+  logDebug("Leds switched by MQTT message");
+}
 
+// seconds of a timer payload value, at most 65535
+uint16_t timerPayloadSeconds(const char* value)
+{
+  unsigned long seconds = strtoul(value, nullptr, 10);
+  return seconds > 0xFFFF ? 0xFFFF : seconds;
+}
 
-void callback(char* topic, byte* payload, unsigned int length) 
+// ledTimerTopic/ledNo: {"off_after":<s>} or {"off_after":"default"} sets the auto-off time, {"off_in":<s>} arms the timer once
+void onMqttLedTimer(uint8_t ledNo, const byte* payload, unsigned int length)
 {
-  Serial.print("Message arrived on topic: ");
-  Serial.print(topic);
-  Serial.print(". Message: ");
-  String payloadTemp;
-  for (unsigned int i = 0; i < length; i++) 
+  char value[12];
+  uint8_t bit = ledBit(ledNo);
+  if (mqttPayloadValue(payload, length, "off_in", value, sizeof(value)))
   {
-    Serial.print((char)payload[i]);
-    payloadTemp += (char)payload[i];
+    if (ledGet(bit) == ON) ledTimerStart(bit, timerPayloadSeconds(value));
+    return;
   }
-  Serial.println(".");
-  //payloadTemp.toUpperCase();
-  //DynamicJsonDocument doc(1024);
-  StaticJsonDocument<512> doc;
-  deserializeJson(doc, payload);
-
-  String topicStr = String(topic);
-  String topicPrefixStr = topicStr.substring(0,topicStr.lastIndexOf('/'));
-  String topicSuffixStr = topicStr.substring(topicStr.lastIndexOf('/')+1);
-  
-  Serial.println(topicPrefixStr);
-  Serial.println(topicSuffixStr);
-
-  uint8_t mqttKey=atoi(String(topicSuffixStr).c_str());
-  uint8_t payloadInt = 2;
-  String payloadState = doc["state"];
-  //Serial.println(mqttKey);
-  //Serial.println(payloadState);
-
-  if (topicPrefixStr.equals(buttonSetTopic))
-  { if (payloadState.equals("0")||payloadState.equals("pressed"))
-    {
-      onSwitchPressed(mqttKey, false);
-      Serial.println("Button pressed by MQTT message");  
-    }
-    else if (payloadState.equals("1")||payloadState.equals("hold_down"))
-    {
-      onSwitchPressed(mqttKey, true);
-      Serial.println("Button hold down by MQTT message");  
-    }
-  }
-  else if (topicPrefixStr.equals(ledSetTopic)) 
+  if (!mqttPayloadValue(payload, length, "off_after", value, sizeof(value))) return;
+  uint16_t seconds = timerPayloadSeconds(value);
+  if (!strcmp(value, "default"))
   {
-    if (payloadState.equals("1")||payloadState.equals("ON")||payloadState.equals("on"))
-    {
-      payloadInt = ON;
-      ioDeviceDigitalWrite(multiIo, mqttKey, payloadInt);
-      saveLedStatesToEeprom(mqttKey,payloadInt); 
-      mqttPublishState(ledStateTopic, mqttKey, payloadInt);
-      Serial.println("Led turned on by MQTT message");
-    }
-    else if (payloadState.equals("0")||payloadState.equals("OFF")||payloadState.equals("off"))
-    {
-      payloadInt = OFF;
-      ioDeviceDigitalWrite(multiIo, mqttKey, payloadInt);
-      saveLedStatesToEeprom(mqttKey,payloadInt);
-      mqttPublishState(ledStateTopic, mqttKey, payloadInt);
-      Serial.println("Led turned off by MQTT message");
-    }
+    seconds = 0;
+    for (uint8_t i = 0; i < registryLeds; i++)
+      if (registryLedNo(i) == ledNo) seconds = registryLedAutoOff(i);
   }
+  ledAutoOffSet(bit, seconds);
+  if (ledGet(bit) == ON) ledTimerStart(bit, seconds);
+  logDebug("Led %u switches off after %u s", ledNo, seconds);
+}
+
+// haStatusTopic: Home Assistant (re)started, the broker may have lost the retained configs
+void onMqttHaStatus(uint8_t, const byte* payload, unsigned int length)
+{
+  if (length == 6 && !memcmp(payload, "online", 6)) discoveryRestart(true);
+}
+
+// latencyGetTopic: publish the latency histograms, "reset" clears them afterwards, and the event counters
+void onMqttLatencyGet(uint8_t, const byte* payload, unsigned int length)
+{
+  latencyRequestReport(length == 5 && !memcmp(payload, "reset", 5));
+  diagCountersRequestReport();
+}
+
+void callback(char* topic, byte* payload, unsigned int length) 
+{
+  latencyEventBegin(latencyMqttToLight, micros());
+  logDebug("Message arrived on topic: %s. Message: %.*s.", topic, (int)length, (const char*)payload);
+  mqttRoute(topic, payload, length);
+  latencyEventEnd();
 }
 
 
@@ -742,194 +670,182 @@ void callback(char* topic, byte* payload, unsigned int length)
 void onSwitchPressed(uint8_t key, bool held)
 { if (key<startLedNo)
   {
-  uint8_t ledState = 2;
   if (key == 2) //EEPROM clear
   {
     clearEeprom();
   } else if ((key == 3) || (key == 120))  //Turn off all leds
     {
-       for (size_t i=0; i<noOfLeds; i++)
-            { 
-              ioDeviceDigitalWrite(multiIo, leds[i].ledNo, OFF);
-              saveLedStatesToEeprom(leds[i].ledNo,OFF);
-              if (mqttConnected) mqttPublishState(ledStateTopic, leds[i].ledNo, OFF);
-              #if debugOn
-                Serial.print("Led no: ");
-                Serial.print(leds[i].ledNo);
-                Serial.println(" OFF");
-              #endif
-            }
-        ioDeviceSync(multiIo); // force another sync    
+      ledsApply(ledAllMask, OFF);
     } 
     else 
     {
-      for(size_t i=0; i<noOfButtons; i++)
-      { if(pgm_read_byte(&(button2leds[i][0]))==key)
-        { for(int j=1;j<maxNoOfLedsPerButton+1;j++) 
-          if (pgm_read_byte(&(button2leds[i][j])) != vL)
-          { 
-            ledState = ioDeviceDigitalReadS(multiIo, pgm_read_byte(&(button2leds[i][j]))+startLedNo);
-            ioDeviceDigitalWrite(multiIo, pgm_read_byte(&(button2leds[i][j]))+startLedNo, !ledState);
-            uint8_t newLedState = ioDeviceDigitalReadS(multiIo, pgm_read_byte(&(button2leds[i][j]))+startLedNo);
-            Serial.print("Led state changed to: ");
-            Serial.println(newLedState);
-            #if debugOn
-              Serial.print("LedState of led: ");
-              Serial.print(pgm_read_byte(&(button2leds[i][j])));
-              Serial.print(" = ");
-              Serial.println(!ledState);
-            #endif
-            saveLedStatesToEeprom(pgm_read_byte(&(button2leds[i][j]))+startLedNo,!ledState);
-            if (mqttConnected) mqttPublishState(ledStateTopic, pgm_read_byte(&(button2leds[i][j]))+startLedNo, !ledState);
-            
-          }
-        }
+      const uint8_t* buttonLed;
+      uint8_t noOfButtonLeds = buttonLeds(key, &buttonLed);
+      bool delayOff = held && holdDelaysOff(key);
+      for (uint8_t j=0; j<noOfButtonLeds; j++)
+      { 
+        if (delayOff) ledSet(buttonLed[j], ON);
+        else ledToggle(buttonLed[j]);
+      }
+      ledsCommit();
+      for (uint8_t j=0; delayOff && j<noOfButtonLeds; j++)
+      {
+        ledTimerStart(buttonLed[j], holdDelayOffS);
       }
-      ioDeviceSync(multiIo); // force another sync
-      #if debugOn
-        Serial.print("Button "); 
-        Serial.print(key);
-        Serial.println(held ? " Held down" : " Pressed");
-        //serialPrintEeprom();
-      #endif
-      if (mqttConnected) mqttPublishState(buttonStateTopic, key, held);
+      logDebug("Button %u %s", key, held ? "Held down" : "Pressed");
+      publishButton(key, held ? gestureLong : gestureSingle);
     }
   }
 }
 
-
-
-// traditional arduino setup function
-void setup() {
-  Wire.begin();
-  Serial.begin(9600);
-  // Setup MQTT
-  mqttClient.setCallback(callback);
-  mqttClient.setBufferSize(512);
-  //Ethernet.init(53);
-  Ethernet.begin(mac, ip, myDns);
-  Serial.println(Ethernet.localIP()); //Print Arduino IP adddress
-  // Connnect to MQTT broker: 5 times every (2 * no of the try) seconds, then Arduino only mode
-  mqttConnected = mqttConnect();
-  // END Setup MQTT
-  //Serial.println(sizeof(button2leds));
- 
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  multiIoAddExpander(multiIo, ioFrom8574(0x38), 20);
-  if (debugOn) Serial.println("added an expander at pin 80 to 89");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  //multiIoAddExpander(multiIo, ioFrom8574(0x39), 10);
-  //if (debugOn) Serial.println("added an expander at pin 90 to 99");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  multiIoAddExpander(multiIo, ioFrom8574(0x3A), 20);
-  if (debugOn) Serial.println("added an expander at pin 100 to 109");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  //multiIoAddExpander(multiIo, ioFrom8574(0x3B), 10);
-  //if (debugOn) Serial.println("added an expander at pin 110 to 119");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  multiIoAddExpander(multiIo, ioFrom8574(0x3C), 20);
-  if (debugOn) Serial.println("added an expander at pin 120 to 129");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  //multiIoAddExpander(multiIo, ioFrom8574(0x3D), 10);
-  //if (debugOn) Serial.println("added an expander at pin 130 to 139");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  multiIoAddExpander(multiIo, ioFrom8574(0x3E), 20);
-  if (debugOn) Serial.println("added an expander at pin 140 to 159");
-
-  // Add an 8574A chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  //multiIoAddExpander(multiIo, ioFrom8574(0x3F), 10);
-  //if (debugOn) Serial.println("added an expander at pin 150 to 159");
-
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo..startLedNo+9
-  multiIoAddExpander(multiIo, ioFrom8574(0x20), 10);
-  if (debugOn) Serial.println("added an expander at pin 160 to 169");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+10..startLedNo+19
-  multiIoAddExpander(multiIo, ioFrom8574(0x21), 10);
-  if (debugOn) Serial.println("added an expander at pin 170 to 179");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+20..startLedNo+29
-  multiIoAddExpander(multiIo, ioFrom8574(0x22), 10);
-  if (debugOn) Serial.println("added an expander at pin 180 to 189");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+30..startLedNo+39
-  multiIoAddExpander(multiIo, ioFrom8574(0x23), 10);
-  if (debugOn) Serial.println("added an expander at pin 190 to 199");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+40..startLedNo+49
-  multiIoAddExpander(multiIo, ioFrom8574(0x24), 10);
-  if (debugOn) Serial.println("added an expander at pin 200 to 209");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+50..startLedNo+59
-  multiIoAddExpander(multiIo, ioFrom8574(0x25), 10);
-  if (debugOn) Serial.println("added an expander at pin 210 to 219");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+50..startLedNo+59
-  multiIoAddExpander(multiIo, ioFrom8574(0x26), 10);
-  if (debugOn) Serial.println("added an expander at pin 220 to 229");
-
-  // Add an 8574 chip that allocates 10 more pins, therefore it goes from startLedNo+50..startLedNo+59
-  //multiIoAddExpander(multiIo, ioFrom8574(0x27), 10);
-  //if (debugOn) Serial.println("added an expander at pin 230 to 239");
-
-
-  Serial.print("Number of leds defined:");
-  Serial.println(noOfLeds);
- 
-  Serial.print("Number of buttons defined:");
-  Serial.println(noOfButtons);
- 
-  // Define Arduino PINs as INPUT. Initialise pullup buttons
-  switches.initialise(multiIo, true);
-  for (size_t i=0; i<noOfButtons; i++)
+// A gesture of a button (buttonGestures.h) or of an MQTT button command: its row in gestureActions, if any
+void onGesture(uint8_t key, uint8_t gesture)
+{
+  uint8_t action;
+  const uint8_t* led = gestureAction(key, gesture, &action);
+  if (!led)
   {
-    switches.addSwitch(pgm_read_byte(&(button2leds[i][0])), onSwitchPressed); 
-    ioDevicePinMode(multiIo, pgm_read_byte(&(button2leds[i][0])), INPUT_PULLUP);
-    if (mqttConnected && pgm_read_byte(&(button2leds[i][0]))<startLedNo)                 //skip expander's fake input switches
-        {
-          mqttSubscribeToTopic(buttonSetTopic, pgm_read_byte(&(button2leds[i][0]))); 
-        }
-  }
-  // Initialize mqtt auto discovery
-  if (mqttConnected) 
-    for (size_t i=0; i<noOfButtons2; i++)
+    if (gesture == gestureLong)
     {
-      mqttSendAutoDiscovery(buttons[i].buttonNo, buttons[i].buttonAutoDiscovery);
-      //mqttSendAutoDiscovery(buttons[i].buttonNo, 0);
+      onSwitchPressed(key, true);
+      return;
     }
+    for (uint8_t n = 0; n <= gesture; n++) onSwitchPressed(key, false);
+    if (gesture != gestureSingle) publishButton(key, gesture);
+    return;
+  }
+  uint8_t mask[noOfOutputExpanders] = {0};
+  bool anyOn = false;
+  for (; pgm_read_byte(led) != vL; led++)
+  {
+    uint8_t bit = ledBit(startLedNo + pgm_read_byte(led));
+    if (bit == noLedBit) continue;
+    mask[bit >> 3] |= 1 << (bit & 7);
+    anyOn = anyOn || ledGet(bit) == ON;
+  }
+  ledsApply(mask, action == gestureOn || (action == gestureToggle && !anyOn) ? ON : OFF);
+  logDebug("Button %u gesture %u", key, gesture);
+  publishButton(key, gesture);
+}
+
+
+// Runs after every (re)connect to the broker: the broker may have restarted and lost subscriptions and retained states
+void onMqttConnected()
+{
+  mqttRouterSubscribe(); // ledSetTopic/+ and buttonSetTopic/+, commands for unknown PINs are dropped
+  // led states and button events that changed while disconnected are already pending in the publish queue
+  discoveryRestart(false); // mqtt auto discovery in the background, only configs that changed
+  bootReport(warmStart); // boot stage times, after the first connect only
+}
 
+// Second boot stage, run by taskManager once setup() is done and the buttons are live (bootStages.h)
+void networkBegin()
+{
+  //Ethernet.init(53);
+  Ethernet.begin(mac, ip, myDns); // waits for the W5x00 reset
+  IPAddress localIp = Ethernet.localIP();
+  logInfo("IP address: %u.%u.%u.%u", localIp[0], localIp[1], localIp[2], localIp[3]);
+  bootStageDone(bootNetwork);
+  // Connect to MQTT broker in the background; lights work with or without it
+  mqttConnectionBegin(mqttBrokerIp, 1883, "arduinoClient", mqttUser, mqttPasswd, onMqttConnected);
+}
 
-  // Define Expanders PINs as OUTPUT
+// traditional arduino setup function: lights and buttons only, the network comes up afterwards (networkBegin)
+void setup() {
+  i2cBusBegin();
+  registryBegin(leds, noOfLeds, buttons, noOfButtons2);
+
+  // Restore led states before anything else. After a warm reset (reset button, watchdog) from the RAM snapshot
+  // (warmRestart.h); after power on the newest journal record, or the old one byte per led area if the journal
+  // was never written. The journal is scanned in both cases: new records continue after its newest one.
+  uint8_t storedPorts[noOfOutputExpanders];
+  warmStart = warmRestartRestore(storedPorts);
+  uint8_t journalPorts[noOfOutputExpanders];
+  uint8_t journalState = journalRestore(journalPorts);
+  if (!warmStart && journalState == journalRestored) memcpy(storedPorts, journalPorts, sizeof(storedPorts));
+  journalBegin();
+  ledTimersBegin(onLedTimersExpired);
+
+  // Output PCF8574 chips (0x20..0x26): ledStatesFlush() writes their port bytes directly,
+  // led startLedNo+10*n..startLedNo+10*n+7 is on the chip 0x20+n
   for (size_t i=0; i<noOfLeds; i++) 
   {
-    ioDevicePinMode(multiIo, leds[i].ledNo, OUTPUT); // Set mode of the PIN number which is stored in table "leds" under address "i" as output
-    EEPROM.get(i,currentEEPROMValue); // Read EEPROM value stored under the address "i"; value LOW = -256, HIGH = -255, no value before = -1.
-    if (currentEEPROMValue == 0 || currentEEPROMValue == 1 )       // If there is either LOW or HIGH stored - set pin state to previously stored value
+    uint8_t bit = ledBit(registryLedNo(i));
+    ledEnable(bit); // PIN number which is stored in table "leds" under address "i" is an output
+    ledAutoOffSet(bit, registryLedAutoOff(i));
+    if (warmStart || journalState == journalRestored)
+    {
+      ledSet(bit, (storedPorts[bit >> 3] >> (bit & 7)) & 1);
+    }
+    else if (journalState == journalEmpty && 
+             (EEPROM.get(eepromLegacyStart+i,currentEEPROMValue) == 0 || currentEEPROMValue == 1))   // LOW or HIGH stored by the old firmware
     { 
-      leds[i].ledState = currentEEPROMValue;
+      ledSet(bit, currentEEPROMValue);
     }                             
-    ioDeviceDigitalWrite(multiIo, leds[i].ledNo, leds[i].ledState);
-    if (mqttConnected)
+    else
     {
-      mqttSubscribeToTopic(ledSetTopic, leds[i].ledNo);
-      mqttSendAutoDiscovery(leds[i].ledNo, leds[i].ledAutoDiscovery);
+      ledSet(bit, registryLedInitState(i));
     }
-    //Serial.print("PIN set as output: ");  
-    //Serial.println(leds[i].ledNo);
   }
-  ioDeviceSync(multiIo); // force another sync
-  Serial.println("Setup is done!");
+  ledStatesFlush();
+  taskManager.scheduleFixedRate(i2cTickMs, ledStatesRetry); // expanders that missed a write (i2cBus.h)
+  bootStageDone(bootLights);
+  warmRestartSave(ledPorts);
+  for (uint8_t bit=0; bit<noOfLedBits; bit++)
+  {
+    if (ledEnabled(bit) && ledGet(bit) == ON) ledTimerStart(bit, ledAutoOff(bit)); // a full period from now
+  }
+  // first journal record, or the snapshot may be newer than the journal
+  if (warmStart || journalState == journalEmpty) journalNoteChange();
+  watchdogBegin();
+
+  buttonMapBuild(button2leds, sizeof(button2leds));
+  // Input PCF8574A chips are read by buttonInputs, each one gives buttons first..first+7 (20 PIN numbers reserved per chip).
+  // Unused addresses: 0x39 (90..), 0x3B (110..), 0x3D (130..), 0x3F (150..)
+  buttonInputsAddExpander(0x38, 80, inputExpanderIntPin);
+  buttonInputsAddExpander(0x3A, 100, inputExpanderIntPin);
+  buttonInputsAddExpander(0x3C, 120, inputExpanderIntPin);
+  buttonInputsAddExpander(0x3E, 140, inputExpanderIntPin);
+  // Define Arduino PINs as INPUT. Initialise pullup buttons
+  for (uint8_t key=0; key<ArduinoPins; key++)
+  {
+    if (buttonConfigured(key)) buttonInputsAddPin(key);
+  }
+  gesturesBegin(gestureActions, sizeof(gestureActions), onGesture);
+  buttonInputsBegin(gesturesInput);
+  bootStageDone(bootButtons);
+
+  Serial.begin(9600);
+  logInfo("%s start, reset flags 0x%02x, lights restored after %lu us", warmStart ? "Warm" : "Cold", resetFlags,
+          (unsigned long)bootStageUs[bootLights]);
+  logDebug("added input expanders at pins 80, 100, 120, 140");
+  logInfo("Number of leds defined:%u", (unsigned int)noOfLeds);
+  logInfo("Number of buttons defined:%u", (unsigned int)noOfButtons);
+  latencyBegin();
+  i2cHealthBegin();
+  diagCountersBegin();
+
+  // Setup MQTT (Ethernet and connecting run in the background, see networkBegin)
+  mqttClient.setCallback(callback);
+  mqttClient.setBufferSize(512);
+  randomSeed(((uint32_t)mac[3] << 16) | (mac[4] << 8) | mac[5]); // MACs differ, so do the retry times
+  mqttRouterOn(topicButtonSet, onMqttButtonSet);
+  mqttRouterOn(topicLedSet, onMqttLedSet);
+  mqttRouterOn(topicLedSetAll, onMqttLedSetAll);
+  mqttRouterOn(topicLedTimer, onMqttLedTimer);
+  mqttRouterOn(topicHaStatus, onMqttHaStatus);
+  mqttRouterOn(topicLatencyGet, onMqttLatencyGet);
+  publishQueueBegin();
+  discoveryBegin(noOfButtons2 + noOfLeds, discoveryConfig);
+  taskManager.scheduleOnce(0, networkBegin);
+  logInfo("Setup is done!");
 }
 
 void loop() 
 {
+  wdt_reset();
   taskManager.runLoop();
   mqttClient.loop();
+  mqttSocket.poll();
+  logDrain();
 }
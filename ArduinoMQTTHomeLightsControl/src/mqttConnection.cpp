@@ -0,0 +1,162 @@
+#include "mqttConnection.h"
+#include <Ethernet.h>
+#include <PubSubClient.h>
+#include <TaskManagerIO.h>
+#include "batchClient.h"
+#include "mqttEncoder.h"
+#include "serialLog.h"
+
+extern EthernetClient ethClient;
+extern BatchClient mqttSocket;
+
+static IPAddress mqttBroker;
+static uint16_t mqttPort;
+static const char* mqttClientId;
+static const char* mqttClientUser;
+static const char* mqttClientPassword;
+static void (*mqttOnConnected)();
+
+static uint32_t mqttBackoff = mqttBackoffMin;
+static uint16_t mqttConnectTimeout = mqttConnectTimeoutMs;
+static uint32_t mqttRetryAt;
+static bool mqttAwaitingConnack = false;
+static uint32_t mqttConnackBy;
+
+// next attempt in backoff/2 .. backoff ms
+static void mqttScheduleRetry()
+{
+  mqttRetryAt = millis() + mqttBackoff / 2 + random(mqttBackoff / 2);
+}
+
+static void mqttConnectFailed(int rc)
+{
+  logWarn("MQTT connection failed, rc=%d", rc);
+  mqttBackoff = mqttBackoff * 2 < mqttBackoffMax ? mqttBackoff * 2 : mqttBackoffMax;
+  mqttScheduleRetry();
+}
+
+static uint16_t mqttPutString(uint16_t pos, const char* string)
+{
+  uint16_t length = strlen(string);
+  mqttMessage[pos++] = length >> 8;
+  mqttMessage[pos++] = length & 0xFF;
+  memcpy(mqttMessage + pos, string, length);
+  return pos + length;
+}
+
+// the CONNECT PubSubClient::connect() would send (MQTT 3.1.1, clean session, user and password), in mqttMessage
+static bool mqttSendConnect()
+{
+  if (strlen(mqttClientId) + strlen(mqttClientUser) + strlen(mqttClientPassword) + 19 > mqttMessageMax) return false;
+  static const uint8_t variableHeader[10] = {0, 4, 'M', 'Q', 'T', 'T', 4, 0x02 | 0x80 | 0x40, 0, MQTT_KEEPALIVE};
+  uint16_t pos = 3;  // room for the fixed header, remaining length in two bytes at most
+  memcpy(mqttMessage + pos, variableHeader, sizeof(variableHeader));
+  pos += sizeof(variableHeader);
+  pos = mqttPutString(pos, mqttClientId);
+  pos = mqttPutString(pos, mqttClientUser);
+  pos = mqttPutString(pos, mqttClientPassword);
+  uint16_t length = pos - 3;
+  uint8_t start = length < 128 ? 1 : 0;
+  mqttMessage[start] = MQTTCONNECT;
+  if (length < 128) mqttMessage[2] = length;
+  else
+  {
+    mqttMessage[1] = (length & 127) | 0x80;
+    mqttMessage[2] = length >> 7;
+  }
+  uint16_t total = pos - start;
+  return mqttSocket.write((const uint8_t*)mqttMessage + start, total) == total;
+}
+
+// TCP connect (bounded by mqttConnectTimeout) and CONNECT; CONNACK is polled by the next ticks
+static void mqttConnectStart()
+{
+  if (Ethernet.linkStatus() == LinkOFF)
+  {
+    mqttConnectFailed(MQTT_CONNECT_FAILED);
+    return;
+  }
+  ethClient.setConnectionTimeout(mqttConnectTimeout);
+  if (!mqttSocket.connect(mqttBroker, mqttPort))
+  {
+    // maybe the broker is just slow to answer: the next attempt waits longer
+    mqttConnectTimeout = mqttConnectTimeout * 2 < mqttConnectTimeoutMaxMs ? mqttConnectTimeout * 2
+                                                                          : mqttConnectTimeoutMaxMs;
+    mqttConnectFailed(MQTT_CONNECT_FAILED);
+    return;
+  }
+  if (!mqttSendConnect())
+  {
+    mqttSocket.stop();
+    mqttConnectFailed(MQTT_CONNECT_FAILED);
+    return;
+  }
+  mqttSocket.flush();
+  mqttAwaitingConnack = true;
+  mqttConnackBy = millis() + mqttConnackTimeoutMs;
+}
+
+static void mqttConnectPoll()
+{
+  if (!mqttSocket.connected())
+  {
+    mqttAwaitingConnack = false;
+    mqttSocket.stop();
+    mqttConnectFailed(MQTT_CONNECTION_LOST);
+    return;
+  }
+  if (mqttSocket.available() < 4)
+  {
+    if ((int32_t)(millis() - mqttConnackBy) < 0) return;
+    mqttAwaitingConnack = false;
+    mqttSocket.stop();
+    mqttConnectFailed(MQTT_CONNECTION_TIMEOUT);
+    return;
+  }
+  mqttAwaitingConnack = false;
+  mqttSocket.dropConnect();
+  if (!mqttClient.connect(mqttClientId, mqttClientUser, mqttClientPassword))
+  {
+    mqttConnectFailed(mqttClient.state());
+    return;
+  }
+  logInfo("MQTT connected");
+  mqttConnected = 1;
+  mqttBackoff = mqttBackoffMin;
+  mqttConnectTimeout = mqttConnectTimeoutMs;
+  if (mqttOnConnected) mqttOnConnected();
+}
+
+static void mqttConnectionTask()
+{
+  if (mqttConnected)
+  {
+    if (mqttClient.connected()) return;
+    mqttConnected = 0;
+    mqttBackoff = mqttBackoffMin;
+    mqttScheduleRetry();
+    logWarn("MQTT connection lost");
+    return;
+  }
+  if (mqttAwaitingConnack)
+  {
+    mqttConnectPoll();
+    return;
+  }
+  if ((int32_t)(millis() - mqttRetryAt) < 0) return;
+  mqttConnectStart();
+}
+
+void mqttConnectionBegin(IPAddress broker, uint16_t port, const char* clientId, const char* user, const char* password,
+                         void (*onConnected)())
+{
+  mqttBroker = broker;
+  mqttPort = port;
+  mqttClientId = clientId;
+  mqttClientUser = user;
+  mqttClientPassword = password;
+  mqttOnConnected = onConnected;
+  mqttClient.setSocketTimeout(mqttSocketTimeoutS);
+  mqttRetryAt = millis();
+  taskManager.scheduleFixedRate(mqttConnectionTickMs, mqttConnectionTask);
+}
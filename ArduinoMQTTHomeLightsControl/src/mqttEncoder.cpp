@@ -0,0 +1,67 @@
+#include "mqttEncoder.h"
+#include "buttonGestures.h"
+
+static const char ledStatePrefix[] PROGMEM = ledStateTopic;
+static const char buttonStatePrefix[] PROGMEM = buttonStateTopic;
+static const char stateAllTopic[] PROGMEM = ledStateAllTopic;
+static const char hexDigits[] PROGMEM = "0123456789abcdef";
+
+static const char payloadOn[] PROGMEM = "{\"state\":\"on\"}";
+static const char payloadOff[] PROGMEM = "{\"state\":\"off\"}";
+// by gesture (buttonGestures.h)
+static const char payloadButton[4][27] PROGMEM =
+  {"{\"state\":\"pressed\"}", "{\"state\":\"double_click\"}", "{\"state\":\"triple_click\"}", "{\"state\":\"held_down\"}"};
+
+char mqttMessage[mqttMessageMax];
+static char mqttTopic[mqttTopicMax];
+
+const char* mqttTopicFor(const char* prefix, uint8_t number)
+{
+  strncpy_P(mqttTopic, prefix, mqttTopicMax - 5);
+  mqttTopic[mqttTopicMax - 5] = 0;
+  char* end = mqttTopic + strlen(mqttTopic);
+  *end++ = '/';
+  utoa(number, end, 10);
+  return mqttTopic;
+}
+
+static bool publishFixed(const char* prefix, uint8_t number, const char* payload, uint8_t length)
+{
+  memcpy_P(mqttMessage, payload, length);
+  return mqttClient.publish(mqttTopicFor(prefix, number), (const uint8_t*)mqttMessage, length, true);
+}
+
+bool mqttPublishLedState(uint8_t ledNo, uint8_t ledState)
+{
+  return ledState == ON
+    ? publishFixed(ledStatePrefix, ledNo, payloadOn, sizeof(payloadOn) - 1)
+    : publishFixed(ledStatePrefix, ledNo, payloadOff, sizeof(payloadOff) - 1);
+}
+
+bool mqttPublishStateAll(uint16_t seq, const uint8_t* ports, uint8_t noOfPorts)
+{
+  if (noOfPorts * 2 + 22 > mqttMessageMax) return false; // {"seq":65535,"on":""} + hex digits
+  char* p = mqttMessage;
+  strcpy_P(p, PSTR("{\"seq\":"));
+  p += strlen(p);
+  utoa(seq, p, 10);
+  p += strlen(p);
+  strcpy_P(p, PSTR(",\"on\":\""));
+  p += strlen(p);
+  for (uint8_t e = 0; e < noOfPorts; e++)
+  {
+    uint8_t on = ~ports[e]; // ports keep PIN levels, ON is 0
+    *p++ = pgm_read_byte(&hexDigits[on >> 4]);
+    *p++ = pgm_read_byte(&hexDigits[on & 15]);
+  }
+  *p++ = '"';
+  *p++ = '}';
+  strcpy_P(mqttTopic, stateAllTopic);
+  return mqttClient.publish(mqttTopic, (const uint8_t*)mqttMessage, p - mqttMessage, true);
+}
+
+bool mqttPublishButtonState(uint8_t key, uint8_t gesture)
+{
+  if (gesture > gestureLong) return false;
+  return publishFixed(buttonStatePrefix, key, payloadButton[gesture], strlen_P(payloadButton[gesture]));
+}
@@ -0,0 +1,119 @@
+#include "mqttRouter.h"
+#include "buttonMap.h"
+#include "ledStates.h"
+#include <PubSubClient.h>
+
+extern PubSubClient mqttClient;
+
+static const char buttonSetPrefix[] PROGMEM = buttonSetTopic "/";
+static const char ledSetPrefix[] PROGMEM = ledSetTopic "/";
+static const char ledSetAll[] PROGMEM = ledSetAllSuffix;
+static const char ledTimerPrefix[] PROGMEM = ledTimerTopic "/";
+static const char haStatus[] PROGMEM = haStatusTopic;
+static const char latencyGet[] PROGMEM = latencyGetTopic;
+
+static MqttHandler mqttHandlers[noOfTopicKinds];
+
+void mqttRouterOn(uint8_t kind, MqttHandler handler)
+{
+  if (kind < noOfTopicKinds) mqttHandlers[kind] = handler;
+}
+
+bool mqttRouterSubscribe()
+{
+  bool ok = mqttClient.subscribe(buttonSetTopic "/+");
+  ok = mqttClient.subscribe(ledSetTopic "/+") && ok;
+  ok = mqttClient.subscribe(ledTimerTopic "/+") && ok;
+  ok = mqttClient.subscribe(latencyGetTopic) && ok;
+  return mqttClient.subscribe(haStatusTopic) && ok;
+}
+
+// topic starts with prefix (PROGMEM): pointer to the rest, else nullptr
+static const char* skipPrefix(const char* topic, const char* prefix)
+{
+  size_t n = strlen_P(prefix);
+  return strncmp_P(topic, prefix, n) == 0 ? topic + n : nullptr;
+}
+
+// 1..3 digits, nothing after them, <= 255
+static bool parsePin(const char* s, uint8_t* pin)
+{
+  uint16_t n = 0;
+  uint8_t digits = 0;
+  for (; *s >= '0' && *s <= '9'; s++)
+  {
+    if (++digits > 3) return false;
+    n = n * 10 + (*s - '0');
+  }
+  if (!digits || *s || n > 255) return false;
+  *pin = n;
+  return true;
+}
+
+uint8_t mqttTopicKind(const char* topic, uint8_t* pin)
+{
+  const char* rest;
+  if ((rest = skipPrefix(topic, ledSetPrefix)))
+  {
+    if (strcmp_P(rest, ledSetAll) == 0) return topicLedSetAll;
+    if (!parsePin(rest, pin)) return topicUnknown;
+    uint8_t bit = ledBit(*pin);
+    return bit != noLedBit && ledEnabled(bit) ? topicLedSet : topicUnknown;
+  }
+  if ((rest = skipPrefix(topic, ledTimerPrefix)))
+  {
+    if (!parsePin(rest, pin)) return topicUnknown;
+    uint8_t bit = ledBit(*pin);
+    return bit != noLedBit && ledEnabled(bit) ? topicLedTimer : topicUnknown;
+  }
+  if ((rest = skipPrefix(topic, buttonSetPrefix)))
+  {
+    if (!parsePin(rest, pin)) return topicUnknown;
+    return buttonConfigured(*pin) ? topicButtonSet : topicUnknown;
+  }
+  if (strcmp_P(topic, haStatus) == 0) return topicHaStatus;
+  if (strcmp_P(topic, latencyGet) == 0) return topicLatencyGet;
+  return topicUnknown;
+}
+
+bool mqttRoute(const char* topic, const uint8_t* payload, unsigned int length)
+{
+  uint8_t pin = 0;
+  uint8_t kind = mqttTopicKind(topic, &pin);
+  if (kind == topicUnknown || !mqttHandlers[kind]) return false;
+  mqttHandlers[kind](pin, payload, length);
+  return true;
+}
+
+static inline bool isSpace(uint8_t c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool mqttPayloadValue(const uint8_t* payload, unsigned int length, const char* key, char* value, uint8_t valueSize)
+{
+  size_t keyLength = strlen(key);
+  const uint8_t* end = payload + length;
+  for (const uint8_t* p = payload; p + keyLength + 2 <= end; p++)
+  {
+    if (*p != '"' || p[keyLength + 1] != '"' || memcmp(p + 1, key, keyLength) != 0) continue;
+    const uint8_t* v = p + keyLength + 2;
+    while (v < end && isSpace(*v)) v++;
+    if (v == end || *v != ':') continue; // a value equal to the key, not the key itself
+    v++;
+    while (v < end && isSpace(*v)) v++;
+    bool quoted = v < end && *v == '"';
+    if (quoted) v++;
+    uint8_t n = 0;
+    for (; v < end; v++)
+    {
+      if (quoted ? *v == '"' : (*v == ',' || *v == '}' || isSpace(*v))) break;
+      if (n + 1 >= valueSize) return false;
+      value[n++] = *v;
+    }
+    if (quoted && v == end) return false;
+    value[n] = 0;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,288 @@
+#include "publishQueue.h"
+#include "ledStates.h"
+#include "mqttEncoder.h"
+#include "mqttConnection.h"
+#include "latencyStats.h"
+#include "batchClient.h"
+#include <TaskManagerIO.h>
+
+extern BatchClient mqttSocket;
+
+uint32_t publishSent = 0;
+uint16_t publishDropped = 0;
+uint16_t publishFailed = 0;
+
+uint16_t publishStateAllSeq = 0;
+
+static uint8_t pendingLeds[noOfOutputExpanders];
+static uint8_t noOfPendingLeds = 0;
+static bool pendingStateAll = false;
+
+struct ButtonEvent
+{
+  uint8_t key;
+  uint8_t gesture;
+};
+
+static ButtonEvent pendingButtons[publishButtonQueueSize];
+static uint8_t pendingButtonsHead = 0;
+static uint8_t noOfPendingButtons = 0;
+
+// buttons with an event while disconnected, and their last gesture (2 bits per button). Two generations:
+// every publishMissedButtonMs the older one is forgotten and the current one becomes the older one.
+static uint8_t missedButtons[(startLedNo + 7) / 8];
+static uint8_t missedButtonsOld[(startLedNo + 7) / 8];
+static uint8_t missedGestures[(startLedNo + 3) / 4];
+static uint8_t noOfMissedButtons = 0;
+static unsigned long missedSince;   // millis() when the current generation started
+
+static uint8_t sweepBit = 0;
+
+// what this tick handed to mqttSocket, queued again if the batch does not reach the socket
+static uint8_t batchLeds[publishPerTick];
+static uint8_t noOfBatchLeds;
+static ButtonEvent batchButtons[publishPerTick];
+static uint8_t noOfBatchButtons;
+static bool batchStateAll;
+
+static bool sending = false;   // connected at the last tick
+static uint32_t queuedSince;   // micros() when the queue stopped being empty, or when sending started
+
+static inline void noteQueued()
+{
+  if (sending && !publishQueueDepth()) queuedSince = micros();
+}
+
+static inline void noteSent()
+{
+  publishSent++;
+  latencyRecord(latencyPublish, micros() - queuedSince);
+}
+
+static void markLed(uint8_t bit)
+{
+  #if publishLedTopics
+    uint8_t m = 1 << (bit & 7);
+    if (pendingLeds[bit >> 3] & m) return;
+    pendingLeds[bit >> 3] |= m;
+    noOfPendingLeds++;
+  #endif
+}
+
+void publishLed(uint8_t bit)
+{
+  if (!ledEnabled(bit)) return;
+  noteQueued();
+  #if publishStateAll
+    pendingStateAll = true;
+  #endif
+  markLed(bit);
+}
+
+void publishLeds(const uint8_t* mask)
+{
+  for (uint8_t e = 0; e < noOfOutputExpanders; e++)
+  {
+    if (!mask[e]) continue;
+    for (uint8_t b = 0; b < 8; b++)
+      if (mask[e] & (1 << b)) publishLed(e * 8 + b);
+  }
+}
+
+// while disconnected only the last event of each button is kept
+static void missButton(uint8_t key, uint8_t gesture)
+{
+  if (key >= startLedNo) return;
+  uint8_t m = 1 << (key & 7);
+  if (!noOfMissedButtons) missedSince = millis();
+  if (!((missedButtons[key >> 3] | missedButtonsOld[key >> 3]) & m)) noOfMissedButtons++;
+  missedButtons[key >> 3] |= m;
+  missedButtonsOld[key >> 3] &= ~m;
+  uint8_t shift = (key & 3) * 2;
+  missedGestures[key >> 2] = (missedGestures[key >> 2] & ~(3 << shift)) | ((gesture & 3) << shift);
+}
+
+void publishButton(uint8_t key, uint8_t gesture)
+{
+  if (!mqttConnected)
+  {
+    missButton(key, gesture);
+    return;
+  }
+  if (noOfPendingButtons == publishButtonQueueSize)
+  {
+    publishDropped++;
+    return;
+  }
+  noteQueued();
+  uint8_t tail = (pendingButtonsHead + noOfPendingButtons) % publishButtonQueueSize;
+  pendingButtons[tail].key = key;
+  pendingButtons[tail].gesture = gesture;
+  noOfPendingButtons++;
+}
+
+uint8_t publishQueueDepth()
+{
+  return noOfPendingLeds + noOfPendingButtons + noOfMissedButtons + pendingStateAll;
+}
+
+// while disconnected: the older generation is dropped publishMissedButtonMs after the current one started
+static void missedButtonsAge()
+{
+  unsigned long now = millis();
+  if (!noOfMissedButtons || now - missedSince < publishMissedButtonMs) return;
+  missedSince = now;
+  for (uint8_t byte = 0; byte < sizeof(missedButtons); byte++)
+  {
+    for (uint8_t old = missedButtonsOld[byte]; old; old &= old - 1) noOfMissedButtons--;
+    missedButtonsOld[byte] = missedButtons[byte];
+    missedButtons[byte] = 0;
+  }
+}
+
+// the connection dropped: button events not sent yet join the missed ones, led states simply stay pending
+static void publishQueueHold()
+{
+  sending = false;
+  while (noOfPendingButtons)
+  {
+    missButton(pendingButtons[pendingButtonsHead].key, pendingButtons[pendingButtonsHead].gesture);
+    pendingButtonsHead = (pendingButtonsHead + 1) % publishButtonQueueSize;
+    noOfPendingButtons--;
+  }
+}
+
+// led states first, they are what the switching was about; then the whole house message and the button events.
+// A large backlog (a long disconnect, boot) sends the whole house message first: one consistent snapshot at once,
+// then its led states drain publishPerTick a tick.
+static bool publishSome()
+{
+  uint8_t budget = publishPerTick;
+  if (pendingStateAll && noOfPendingLeds > publishSnapshotAbove)
+  {
+    if (!mqttPublishStateAll(publishStateAllSeq + 1, ledPorts, noOfOutputExpanders)) return false;
+    budget--;
+    publishStateAllSeq++;
+    pendingStateAll = false;
+    batchStateAll = true;
+    noteSent();
+  }
+  for (uint8_t e = 0; e < noOfOutputExpanders && budget && noOfPendingLeds; e++)
+  {
+    while (pendingLeds[e] && budget)
+    {
+      uint8_t b = 0;
+      while (!(pendingLeds[e] & (1 << b))) b++;
+      uint8_t bit = e * 8 + b;
+      budget--;
+      if (!mqttPublishLedState(ledBitToNo(bit), ledGet(bit))) return false; // stays pending, retried on the next tick
+      pendingLeds[e] &= ~(1 << b);
+      noOfPendingLeds--;
+      batchLeds[noOfBatchLeds++] = bit;
+      noteSent();
+    }
+  }
+  if (pendingStateAll && budget && !noOfPendingLeds)
+  {
+    budget--;
+    if (!mqttPublishStateAll(publishStateAllSeq + 1, ledPorts, noOfOutputExpanders)) return false;
+    publishStateAllSeq++;
+    pendingStateAll = false;
+    batchStateAll = true;
+    noteSent();
+  }
+  while (noOfPendingButtons && budget)
+  {
+    ButtonEvent event = pendingButtons[pendingButtonsHead];
+    budget--;
+    if (!mqttPublishButtonState(event.key, event.gesture)) return false; // stays first in the FIFO
+    pendingButtonsHead = (pendingButtonsHead + 1) % publishButtonQueueSize;
+    noOfPendingButtons--;
+    batchButtons[noOfBatchButtons++] = event;
+    noteSent();
+  }
+  for (uint8_t byte = 0; noOfMissedButtons && budget && byte < sizeof(missedButtons); byte++)
+  {
+    while ((missedButtons[byte] | missedButtonsOld[byte]) && budget)
+    {
+      uint8_t b = 0;
+      while (!((missedButtons[byte] | missedButtonsOld[byte]) & (1 << b))) b++;
+      uint8_t key = byte * 8 + b;
+      uint8_t gesture = (missedGestures[key >> 2] >> ((key & 3) * 2)) & 3;
+      budget--;
+      if (!mqttPublishButtonState(key, gesture)) return false;
+      missedButtons[byte] &= ~(1 << b);
+      missedButtonsOld[byte] &= ~(1 << b);
+      noOfMissedButtons--;
+      batchButtons[noOfBatchButtons].key = key;
+      batchButtons[noOfBatchButtons++].gesture = gesture;
+      noteSent();
+    }
+  }
+  return true;
+}
+
+// The batch of this tick did not reach the socket (the connection died under it): its leds, the whole house message
+// and its button events are pending again, the connection manager reconnects.
+static void publishRequeue()
+{
+  for (uint8_t i = 0; i < noOfBatchLeds; i++) markLed(batchLeds[i]);
+  if (batchStateAll) pendingStateAll = true;
+  for (uint8_t i = 0; i < noOfBatchButtons; i++) missButton(batchButtons[i].key, batchButtons[i].gesture);
+}
+
+static void publishTask()
+{
+  if (!mqttConnected)
+  {
+    if (sending || noOfPendingButtons) publishQueueHold();
+    missedButtonsAge();
+    return;
+  }
+  if (!sending)
+  {
+    sending = true;
+    queuedSince = micros();
+  }
+  if (!publishQueueDepth()) return;
+  noOfBatchLeds = noOfBatchButtons = 0;
+  batchStateAll = false;
+  bool ok = publishSome();
+  if (!mqttSocket.push())
+  {
+    publishRequeue();
+    ok = false;
+  }
+  if (!ok) publishFailed++;
+}
+
+// anti-entropy: one more led state every publishSweepMs, the whole house message after each round
+static void publishSweep()
+{
+  if (!mqttConnected) return;
+  for (uint8_t n = 0; n < noOfLedBits; n++)
+  {
+    uint8_t bit = sweepBit;
+    sweepBit = (sweepBit + 1) % noOfLedBits;
+    #if publishStateAll
+      if (!sweepBit)  // a round is over, whether or not the last bits are leds
+      {
+        noteQueued();
+        pendingStateAll = true;
+      }
+    #endif
+    if (!ledEnabled(bit)) continue;
+    noteQueued();
+    markLed(bit);
+    return;
+  }
+}
+
+void publishQueueBegin()
+{
+  publishLeds(ledAllMask);  // the broker has not heard from this boot yet: the first connect sends every state
+  taskManager.scheduleFixedRate(publishTickMs, publishTask);
+  #if publishSweepMs
+    taskManager.scheduleFixedRate(publishSweepMs, publishSweep);
+  #endif
+}
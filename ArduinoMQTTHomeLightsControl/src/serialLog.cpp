@@ -0,0 +1,51 @@
+#include "serialLog.h"
+#include <stdarg.h>
+
+uint16_t logDropped = 0;
+
+// 8 bit indices wrap by themselves; one byte stays free to tell full from empty
+static char logRing[256];
+static uint8_t logHead = 0;   // next byte to write
+static uint8_t logTail = 0;   // next byte to send
+static uint16_t logDroppedReported = 0;
+
+static bool logPut(const char* text, uint8_t len)
+{
+  if ((uint8_t)(logTail - logHead - 1) < len) return false;
+  while (len--) logRing[logHead++] = *text++;
+  return true;
+}
+
+void logWrite(const char* format, ...)
+{
+  char line[logLineMax];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf_P(line, sizeof(line), format, args);
+  va_end(args);
+  if (len < 0) return;
+  if (len >= (int)sizeof(line))
+  {
+    len = sizeof(line) - 1;
+    line[len - 2] = '\r';
+    line[len - 1] = '\n';
+  }
+  if (logDropped != logDroppedReported)
+  {
+    char note[32];
+    uint8_t noteLen = snprintf_P(note, sizeof(note), PSTR("%u log messages dropped\r\n"), logDropped - logDroppedReported);
+    if (!logPut(note, noteLen))
+    {
+      logDropped++;
+      return;
+    }
+    logDroppedReported = logDropped;
+  }
+  if (!logPut(line, len)) logDropped++;
+}
+
+void logDrain()
+{
+  int room = Serial.availableForWrite();
+  while (room-- > 0 && logTail != logHead) Serial.write((uint8_t)logRing[logTail++]);
+}
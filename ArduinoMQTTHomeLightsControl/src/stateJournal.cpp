@@ -0,0 +1,201 @@
+#include "stateJournal.h"
+#include "ledStates.h"
+#include "latencyStats.h"
+#include <EEPROM.h>
+#include <TaskManagerIO.h>
+
+#define journalEmptySeq 0xFFFF
+#define journalMagic 0xA0
+#define journalMagicMask 0xF0
+#define journalFlagCleared 0x01
+
+struct JournalRecord
+{
+  uint16_t seq;
+  uint8_t flags;
+  uint8_t ports[noOfOutputExpanders];
+  uint8_t crc;    // CRC-8 of all previous bytes, written last
+};
+
+#define journalSlots (eepromJournalSize / sizeof(JournalRecord))
+
+static int16_t lastSlot = -1;            // slot of the newest record, -1 if none
+static uint16_t lastSeq = 0;
+static uint8_t committedPorts[noOfOutputExpanders];
+static bool committedValid = false;
+
+static bool dirty = false;
+static bool clearPending = false;
+static unsigned long firstChange;
+static unsigned long lastChange;
+
+static JournalRecord pending;
+static uint8_t writePos = sizeof(JournalRecord);   // == sizeof: nothing being written
+static uint16_t writeSlot;
+
+struct JournalWord
+{
+  uint16_t address;
+  uint16_t value;
+};
+
+static JournalWord words[journalWordQueueSize];
+static uint8_t wordsHead = 0;
+static uint8_t noOfWords = 0;
+static uint8_t wordPos = 0;   // byte of words[wordsHead] written next
+
+static uint16_t slotAddress(uint16_t slot)
+{
+  return eepromJournalStart + slot * sizeof(JournalRecord);
+}
+
+uint8_t crc8(const uint8_t* data, uint8_t len)
+{
+  uint8_t crc = 0;
+  while (len--)
+  {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+  }
+  return crc;
+}
+
+static uint16_t readSeq(uint16_t slot)
+{
+  uint16_t seq;
+  EEPROM.get(slotAddress(slot), seq);
+  return seq;
+}
+
+static bool readRecord(uint16_t slot, JournalRecord& record)
+{
+  EEPROM.get(slotAddress(slot), record);
+  return record.seq != journalEmptySeq
+    && (record.flags & journalMagicMask) == journalMagic
+    && record.crc == crc8((const uint8_t*)&record, sizeof(record) - 1);
+}
+
+uint8_t journalRestore(uint8_t* ports)
+{
+  // newest sequence number, in serial number arithmetic so it survives wrapping
+  int16_t newest = -1;
+  uint16_t newestSeq = 0;
+  for (uint16_t slot = 0; slot < journalSlots; slot++)
+  {
+    uint16_t seq = readSeq(slot);
+    if (seq == journalEmptySeq) continue;
+    if (newest < 0 || (uint16_t)(seq - newestSeq) < 0x8000)
+    {
+      newest = slot;
+      newestSeq = seq;
+    }
+  }
+  if (newest < 0) return journalEmpty;
+  // new records continue after the newest one, even if it turns out to be broken
+  lastSlot = newest;
+  lastSeq = newestSeq;
+  // the newest may be torn by a power cut - walk back to the previous records
+  JournalRecord record;
+  for (uint8_t tries = 0; newest >= 0 && tries < 4; tries++)
+  {
+    if (readRecord(newest, record) && record.seq == newestSeq)
+    {
+      if (record.flags & journalFlagCleared) return journalCleared;
+      memcpy(ports, record.ports, sizeof(record.ports));
+      memcpy(committedPorts, record.ports, sizeof(record.ports));
+      committedValid = true;
+      return journalRestored;
+    }
+    newest = newest ? newest - 1 : journalSlots - 1;
+    newestSeq--;
+    if (newestSeq == journalEmptySeq) newestSeq--;
+  }
+  return journalCleared;
+}
+
+static void startCommit(uint8_t flags)
+{
+  pending.seq = lastSeq + 1;
+  if (pending.seq == journalEmptySeq) pending.seq++;
+  pending.flags = journalMagic | flags;
+  memcpy(pending.ports, ledPorts, sizeof(pending.ports));
+  pending.crc = crc8((const uint8_t*)&pending, sizeof(pending) - 1);
+  writeSlot = lastSlot < 0 ? 0 : (lastSlot + 1) % journalSlots;
+  writePos = 0;
+}
+
+static void writeByte(uint16_t address, uint8_t value)
+{
+  uint32_t startedAt = micros();
+  EEPROM.update(address, value);
+  latencyRecord(latencyPersist, micros() - startedAt);
+}
+
+// one EEPROM byte per tick: the AVR only busy-waits when a write is started before the previous one is done
+static void journalTask()
+{
+  if (writePos < sizeof(JournalRecord))
+  {
+    writeByte(slotAddress(writeSlot) + writePos, ((const uint8_t*)&pending)[writePos]);
+    if (++writePos == sizeof(JournalRecord))
+    {
+      lastSlot = writeSlot;
+      lastSeq = pending.seq;
+      memcpy(committedPorts, pending.ports, sizeof(committedPorts));
+      committedValid = !(pending.flags & journalFlagCleared);
+    }
+    return;
+  }
+  if (noOfWords)
+  {
+    const JournalWord& word = words[wordsHead];
+    writeByte(word.address + wordPos, ((const uint8_t*)&word.value)[wordPos]);
+    if (++wordPos == sizeof(word.value))
+    {
+      wordPos = 0;
+      wordsHead = (wordsHead + 1) % journalWordQueueSize;
+      noOfWords--;
+    }
+    return;
+  }
+  if (clearPending)
+  {
+    clearPending = false;
+    startCommit(journalFlagCleared);
+    return;
+  }
+  if (!dirty) return;
+  unsigned long now = millis();
+  if (now - lastChange < journalQuietTime && now - firstChange < journalMaxDelay) return;
+  dirty = false;
+  if (committedValid && !memcmp(committedPorts, ledPorts, sizeof(committedPorts))) return;   // toggled back
+  startCommit(0);
+}
+
+void journalBegin()
+{
+  taskManager.scheduleFixedRate(journalTickMs, journalTask);
+}
+
+void journalNoteChange()
+{
+  lastChange = millis();
+  if (!dirty) firstChange = lastChange;
+  dirty = true;
+}
+
+void journalClear()
+{
+  dirty = false;
+  clearPending = true;
+}
+
+bool journalWriteWord(uint16_t address, uint16_t value)
+{
+  if (noOfWords == journalWordQueueSize) return false;
+  JournalWord& word = words[(wordsHead + noOfWords) % journalWordQueueSize];
+  word.address = address;
+  word.value = value;
+  noOfWords++;
+  return true;
+}
@@ -0,0 +1,58 @@
+#include "warmRestart.h"
+#include "ledStates.h"
+#include "stateJournal.h"
+
+#define warmMagic 0x5A
+
+struct WarmSnapshot
+{
+  uint8_t magic;
+  uint8_t ports[noOfOutputExpanders];
+  uint8_t crc;    // CRC-8 of all previous bytes
+};
+
+#ifdef __AVR__
+uint8_t resetFlags __attribute__((section(".noinit")));
+static WarmSnapshot snapshot __attribute__((section(".noinit")));
+
+// runs before the C runtime initialises variables and before main()
+void readResetFlags() __attribute__((naked, used, section(".init3")));
+void readResetFlags()
+{
+  resetFlags = MCUSR;
+  MCUSR = 0;
+  wdt_disable();
+}
+#else
+uint8_t resetFlags;
+static WarmSnapshot snapshot;
+#endif
+
+bool warmRestartRestore(uint8_t* ports)
+{
+  #ifndef __AVR__
+    resetFlags = MCUSR;
+    MCUSR = 0;
+  #endif
+  if (resetFlags & ((1 << PORF) | (1 << BORF))) return false;  // RAM was not kept
+  if (snapshot.magic != warmMagic || snapshot.crc != crc8((const uint8_t*)&snapshot, sizeof(snapshot) - 1)) return false;
+  memcpy(ports, snapshot.ports, sizeof(snapshot.ports));
+  return true;
+}
+
+void warmRestartSave(const uint8_t* ports)
+{
+  snapshot.magic = warmMagic;
+  memcpy(snapshot.ports, ports, sizeof(snapshot.ports));
+  snapshot.crc = crc8((const uint8_t*)&snapshot, sizeof(snapshot) - 1);
+}
+
+void warmRestartClear()
+{
+  snapshot.magic = 0;
+}
+
+void watchdogBegin()
+{
+  wdt_enable(watchdogTimeout);
+}
@@ -0,0 +1,92 @@
+/*
+buttonMap: the RAM index built from vL terminated button2leds rows.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include "buttonMap.h"
+#include "ledStates.h"
+
+// led numbers in button2leds count from startLedNo: 12 is expander 0x21 P2, 27 is 0x22 P7, 8 is not an output
+static const uint8_t table[] PROGMEM = {
+  3, 0, 1, vL,
+  7, 12, 8, vL,
+  200, 2, vL,     // not a button PIN: its leds go nowhere
+  5, vL,          // no leds
+  9, 27           // last row, no vL
+};
+
+void setUp() {}
+void tearDown() {}
+
+static void assertLeds(uint8_t key, const uint8_t* expected, uint8_t n)
+{
+  const uint8_t* leds = nullptr;
+  TEST_ASSERT_EQUAL_UINT8(n, buttonLeds(key, &leds));
+  if (n) TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, leds, n);
+}
+
+static void test_rows()
+{
+  buttonMapBuild(table, sizeof(table));
+  TEST_ASSERT_EQUAL_UINT8(4, noOfButtons);
+  const uint8_t leds3[] = {ledBit(startLedNo + 0), ledBit(startLedNo + 1)};
+  const uint8_t leds7[] = {ledBit(startLedNo + 12)};
+  const uint8_t leds9[] = {ledBit(startLedNo + 27)};
+  assertLeds(3, leds3, 2);
+  assertLeds(7, leds7, 1);
+  assertLeds(5, nullptr, 0);
+  assertLeds(9, leds9, 1);
+  TEST_ASSERT_EQUAL_UINT8(23, leds9[0]);
+}
+
+static void test_configured()
+{
+  buttonMapBuild(table, sizeof(table));
+  TEST_ASSERT_TRUE(buttonConfigured(3));
+  TEST_ASSERT_TRUE(buttonConfigured(5));
+  TEST_ASSERT_TRUE(buttonConfigured(9));
+  TEST_ASSERT_FALSE(buttonConfigured(4));
+  TEST_ASSERT_FALSE(buttonConfigured(200));
+  assertLeds(4, nullptr, 0);
+  assertLeds(200, nullptr, 0);
+}
+
+static void test_rebuild()
+{
+  static const uint8_t other[] PROGMEM = {4, 5, vL};
+  buttonMapBuild(table, sizeof(table));
+  buttonMapBuild(other, sizeof(other));
+  TEST_ASSERT_EQUAL_UINT8(1, noOfButtons);
+  TEST_ASSERT_FALSE(buttonConfigured(3));
+  assertLeds(3, nullptr, 0);
+  const uint8_t leds4[] = {ledBit(startLedNo + 5)};
+  assertLeds(4, leds4, 1);
+}
+
+static void test_too_many_links()
+{
+  // maxButtonLedLinks + 10 links: the first maxButtonLedLinks are kept
+  static uint8_t big[3 + maxButtonLedLinks + 10 + 1];
+  size_t n = 0;
+  big[n++] = 1;
+  for (uint8_t i = 0; i < maxButtonLedLinks + 10; i++) big[n++] = i % 8;
+  big[n++] = vL;
+  big[n++] = 2;
+  big[n++] = 3;
+  buttonMapBuild(big, n);
+  const uint8_t* leds = nullptr;
+  TEST_ASSERT_EQUAL_UINT8(maxButtonLedLinks, buttonLeds(1, &leds));
+  TEST_ASSERT_EQUAL_UINT8(7, leds[maxButtonLedLinks - 1]);
+  TEST_ASSERT_TRUE(buttonConfigured(2));
+  assertLeds(2, nullptr, 0);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rows);
+  RUN_TEST(test_configured);
+  RUN_TEST(test_rebuild);
+  RUN_TEST(test_too_many_links);
+  return UNITY_END();
+}
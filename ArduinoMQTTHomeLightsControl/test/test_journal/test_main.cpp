@@ -0,0 +1,96 @@
+/*
+stateJournal: which record journalRestore() picks after clean commits, a commit cut short by a power loss
+and a journal that wrapped around its EEPROM area.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <TaskManagerIO.h>
+#include "stateJournal.h"
+#include "ledStates.h"
+
+// seq, flags, ports, crc
+#define recordSize (noOfOutputExpanders + 4)
+#define journalSlots (eepromJournalSize / recordSize)
+
+void setUp() {}
+void tearDown() {}
+
+static void runFor(uint32_t ms)
+{
+  for (uint32_t i = 0; i < ms; i++)
+  {
+    shimAdvanceMicros(1000);
+    taskManager.runLoop();
+  }
+}
+
+// every port set to value, written to the journal
+static void commit(uint8_t value)
+{
+  memset(ledPorts, value, sizeof(ledPorts));
+  journalNoteChange();
+  runFor(journalQuietTime + 2 * recordSize * journalTickMs);
+}
+
+static void assertRestored(uint8_t value)
+{
+  uint8_t expected[noOfOutputExpanders];
+  uint8_t ports[noOfOutputExpanders];
+  memset(expected, value, sizeof(expected));
+  memset(ports, 0, sizeof(ports));
+  TEST_ASSERT_EQUAL_UINT8(journalRestored, journalRestore(ports));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, ports, sizeof(ports));
+}
+
+static void test_restore_empty()
+{
+  uint8_t ports[noOfOutputExpanders];
+  TEST_ASSERT_EQUAL_UINT8(journalEmpty, journalRestore(ports));
+}
+
+static void test_restore_newest()
+{
+  commit(0x11);
+  commit(0x22);
+  assertRestored(0x22);
+}
+
+static void test_restore_after_torn_record()
+{
+  commit(0x33);
+  // the power goes off while the next record is being written: its sequence number is there, its CRC is not
+  memset(ledPorts, 0x44, sizeof(ledPorts));
+  journalNoteChange();
+  uint32_t writes = shimStats.eepromWrites;
+  runFor(journalQuietTime + 4 * journalTickMs);
+  TEST_ASSERT_GREATER_THAN(0, shimStats.eepromWrites - writes);
+  TEST_ASSERT_LESS_THAN(recordSize, shimStats.eepromWrites - writes);
+  assertRestored(0x33);
+
+  // the writer finishes the record: it is the newest one from then on
+  runFor(2 * recordSize * journalTickMs);
+  assertRestored(0x44);
+}
+
+static void test_restore_after_wrap_around()
+{
+  // the newest record ends up in slot 4, after it the oldest ones
+  for (uint16_t i = 0; i < journalSlots + 5; i++) commit(i);
+  assertRestored((journalSlots + 4) & 0xFF);
+
+  // new records go on after the restored one
+  commit(0x55);
+  assertRestored(0x55);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  journalBegin();
+  RUN_TEST(test_restore_empty);
+  RUN_TEST(test_restore_newest);
+  RUN_TEST(test_restore_after_torn_record);
+  RUN_TEST(test_restore_after_wrap_around);
+  return UNITY_END();
+}
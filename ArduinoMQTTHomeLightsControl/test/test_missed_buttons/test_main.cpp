@@ -0,0 +1,87 @@
+/*
+publishQueue while disconnected: the whole sketch against NativeShim with the broker down. Button events
+missed meanwhile are kept for publishMissedButtonMs to twice that, then dropped; recent ones go out after
+the reconnect.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include "publishQueue.h"
+#include "buttonGestures.h"
+#include "mqttConnection.h"
+
+void setup();
+void loop();
+
+void setUp() {}
+void tearDown() {}
+
+static void runFor(uint32_t ms)
+{
+  for (uint32_t i = 0; i < ms; i++)
+  {
+    shimAdvanceMicros(1000);
+    loop();
+  }
+}
+
+static void brokerDown()
+{
+  shimBrokerUp = false;
+  for (uint32_t i = 0; i < 60000 && mqttConnected; i++) runFor(1);
+  TEST_ASSERT_FALSE(mqttConnected);
+  runFor(2 * publishMissedButtonMs);
+  TEST_ASSERT_EQUAL_UINT8(0, publishQueueDepth());
+}
+
+static void brokerUp()
+{
+  shimBrokerUp = true;
+  for (uint32_t i = 0; i < 120000 && !mqttConnected; i++) runFor(1);
+  TEST_ASSERT_TRUE(mqttConnected);
+}
+
+static void test_old_events_dropped()
+{
+  brokerDown();
+  publishButton(7, gestureSingle);
+  publishButton(8, gestureDouble);
+  runFor(publishMissedButtonMs - 100);
+  TEST_ASSERT_EQUAL_UINT8(2, publishQueueDepth());
+  runFor(publishMissedButtonMs + 200);
+  TEST_ASSERT_EQUAL_UINT8(0, publishQueueDepth());
+  brokerUp();
+}
+
+static void test_recent_events_sent()
+{
+  brokerDown();
+  publishButton(7, gestureSingle);
+  runFor(publishMissedButtonMs + 100);
+  // a second event of the same button: it is as old as its newest event
+  publishButton(7, gestureLong);
+  publishButton(9, gestureSingle);
+  runFor(publishMissedButtonMs + 100);
+  TEST_ASSERT_EQUAL_UINT8(2, publishQueueDepth());
+  uint32_t sent = publishSent;
+  brokerUp();
+  runFor(1000);
+  TEST_ASSERT_EQUAL_UINT8(0, publishQueueDepth());
+  TEST_ASSERT_EQUAL_UINT(2, publishSent - sent);
+}
+
+int main(int argc, char** argv)
+{
+  for (uint8_t address = 0x20; address <= 0x26; address++) shimI2cAddDevice(address);
+  for (uint8_t address = 0x38; address <= 0x3E; address += 2)
+  {
+    shimI2cAddDevice(address);
+    shimI2cSetIntPin(address, inputExpanderIntPin);
+  }
+  setup();
+  runFor(30000);  // connected, boot states and discovery sent
+
+  UNITY_BEGIN();
+  RUN_TEST(test_old_events_dropped);
+  RUN_TEST(test_recent_events_sent);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+/*
+mqttRouter: topic -> kind and PIN, configured PINs only, and reading values out of JSON payloads.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include "mqttRouter.h"
+#include "buttonMap.h"
+#include "ledStates.h"
+
+static const uint8_t table[] PROGMEM = {7, 0, vL};
+
+static uint8_t routedPin;
+static unsigned int routedLength;
+
+static void onLedSet(uint8_t pin, const uint8_t* payload, unsigned int length)
+{
+  routedPin = pin;
+  routedLength = length;
+}
+
+void setUp()
+{
+  routedPin = 0;
+  routedLength = 0;
+}
+
+void tearDown() {}
+
+static uint8_t kind(const char* topic, uint8_t* pin)
+{
+  *pin = 0;
+  return mqttTopicKind(topic, pin);
+}
+
+static void test_led_topics()
+{
+  uint8_t pin;
+  TEST_ASSERT_EQUAL_UINT8(topicLedSet, kind(ledSetTopic "/160", &pin));
+  TEST_ASSERT_EQUAL_UINT8(160, pin);
+  TEST_ASSERT_EQUAL_UINT8(topicLedSet, kind(ledSetTopic "/171", &pin));
+  TEST_ASSERT_EQUAL_UINT8(171, pin);
+  TEST_ASSERT_EQUAL_UINT8(topicLedTimer, kind(ledTimerTopic "/171", &pin));
+  TEST_ASSERT_EQUAL_UINT8(171, pin);
+  TEST_ASSERT_EQUAL_UINT8(topicLedSetAll, kind(ledSetTopic "/" ledSetAllSuffix, &pin));
+  // an output that is not in leds[], and numbers that are not outputs at all
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/161", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/168", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledTimerTopic "/7", &pin));
+}
+
+static void test_button_topics()
+{
+  uint8_t pin;
+  TEST_ASSERT_EQUAL_UINT8(topicButtonSet, kind(buttonSetTopic "/7", &pin));
+  TEST_ASSERT_EQUAL_UINT8(7, pin);
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(buttonSetTopic "/8", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(buttonSetTopic "/160", &pin));
+}
+
+static void test_fixed_topics()
+{
+  uint8_t pin;
+  TEST_ASSERT_EQUAL_UINT8(topicHaStatus, kind(haStatusTopic, &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicLatencyGet, kind(latencyGetTopic, &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic, &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(haStatusTopic "/x", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind("arduino02/led/set/160", &pin));
+}
+
+static void test_malformed_pins()
+{
+  uint8_t pin;
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/0160", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/16a", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/160/x", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(ledSetTopic "/-160", &pin));
+  TEST_ASSERT_EQUAL_UINT8(topicUnknown, kind(buttonSetTopic "/263", &pin));  // 263 & 0xFF = 7
+}
+
+static void test_route()
+{
+  const uint8_t payload[] = "{\"state\":\"on\"}";
+  TEST_ASSERT_TRUE(mqttRoute(ledSetTopic "/171", payload, sizeof(payload) - 1));
+  TEST_ASSERT_EQUAL_UINT8(171, routedPin);
+  TEST_ASSERT_EQUAL_UINT(sizeof(payload) - 1, routedLength);
+  // no handler for the kind, not configured
+  TEST_ASSERT_FALSE(mqttRoute(buttonSetTopic "/7", payload, sizeof(payload) - 1));
+  TEST_ASSERT_FALSE(mqttRoute(ledSetTopic "/161", payload, sizeof(payload) - 1));
+}
+
+static bool value(const char* payload, const char* key, char* out, uint8_t size)
+{
+  return mqttPayloadValue((const uint8_t*)payload, strlen(payload), key, out, size);
+}
+
+static void test_payload_value()
+{
+  char v[20];
+  TEST_ASSERT_TRUE(value("{\"state\":\"on\",\"mask\":\"00ff000000000000\"}", "state", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("on", v);
+  TEST_ASSERT_TRUE(value("{\"state\":\"on\",\"mask\":\"00ff000000000000\"}", "mask", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("00ff000000000000", v);
+  // unquoted, white space
+  TEST_ASSERT_TRUE(value("{ \"off_after\" : 300 }", "off_after", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("300", v);
+  TEST_ASSERT_TRUE(value("{\"off_in\":60,\"state\":\"off\"}", "off_in", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("60", v);
+  // a value equal to the key is not the key
+  TEST_ASSERT_TRUE(value("{\"action\":\"state\",\"state\":\"off\"}", "state", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("off", v);
+  TEST_ASSERT_TRUE(value("{\"state\":\"\"}", "state", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("", v);
+}
+
+static void test_payload_value_rejects()
+{
+  char v[4];
+  TEST_ASSERT_FALSE(value("{\"state\":\"on\"}", "mask", v, sizeof(v)));
+  TEST_ASSERT_FALSE(value("{\"statex\":\"on\"}", "state", v, sizeof(v)));
+  TEST_ASSERT_FALSE(value("{\"state\":\"toggle\"}", "state", v, sizeof(v)));   // does not fit
+  TEST_ASSERT_FALSE(value("{\"state\":\"on", "state", v, sizeof(v)));          // unterminated
+  TEST_ASSERT_FALSE(value("on", "state", v, sizeof(v)));
+  // the payload is not 0 terminated: nothing after length is read
+  const char* payload = "{\"state\":\"on\"}";
+  TEST_ASSERT_FALSE(mqttPayloadValue((const uint8_t*)payload, 11, "state", v, sizeof(v)));
+  TEST_ASSERT_TRUE(mqttPayloadValue((const uint8_t*)payload, 13, "state", v, sizeof(v)));
+  TEST_ASSERT_EQUAL_STRING("on", v);
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  ledEnable(ledBit(160));
+  ledEnable(ledBit(171));
+  buttonMapBuild(table, sizeof(table));
+  mqttRouterOn(topicLedSet, onLedSet);
+  RUN_TEST(test_led_topics);
+  RUN_TEST(test_button_topics);
+  RUN_TEST(test_fixed_topics);
+  RUN_TEST(test_malformed_pins);
+  RUN_TEST(test_route);
+  RUN_TEST(test_payload_value);
+  RUN_TEST(test_payload_value_rejects);
+  return UNITY_END();
+}
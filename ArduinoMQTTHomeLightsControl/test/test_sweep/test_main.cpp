@@ -0,0 +1,71 @@
+/*
+publishQueue sweep: the whole sketch against NativeShim, connected and idle. Every round of the sweep ends
+with the whole house message, also when the last bits of the round are not leds.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include "publishQueue.h"
+#include "ledStates.h"
+#include "mqttConnection.h"
+
+void setup();
+void loop();
+
+#define roundMs ((uint32_t)publishSweepMs * noOfLedBits)
+
+void setUp() {}
+void tearDown() {}
+
+static void runFor(uint32_t ms)
+{
+  for (uint32_t i = 0; i < ms; i++)
+  {
+    shimAdvanceMicros(1000);
+    loop();
+  }
+}
+
+// ms until the next whole house message, 0 if none within ms
+static uint32_t untilStateAll(uint32_t ms)
+{
+  uint16_t seq = publishStateAllSeq;
+  for (uint32_t i = 1; i <= ms; i++)
+  {
+    runFor(1);
+    if (publishStateAllSeq != seq) return i;
+  }
+  return 0;
+}
+
+static void test_round_ends_with_state_all()
+{
+  TEST_ASSERT_TRUE(mqttConnected);
+  TEST_ASSERT_EQUAL_UINT8(0, publishQueueDepth());
+  TEST_ASSERT_GREATER_THAN(0, untilStateAll(roundMs + publishSweepMs));
+}
+
+static void test_once_per_round()
+{
+  // right after a round ended: the next rounds end roundMs apart, with nothing in between
+  untilStateAll(roundMs + publishSweepMs);
+  uint16_t seq = publishStateAllSeq;
+  runFor(2 * roundMs + publishSweepMs / 2);
+  TEST_ASSERT_EQUAL_UINT16(2, publishStateAllSeq - seq);
+}
+
+int main(int argc, char** argv)
+{
+  for (uint8_t address = 0x20; address <= 0x26; address++) shimI2cAddDevice(address);
+  for (uint8_t address = 0x38; address <= 0x3E; address += 2)
+  {
+    shimI2cAddDevice(address);
+    shimI2cSetIntPin(address, inputExpanderIntPin);
+  }
+  setup();
+  runFor(30000);  // connected, boot states and discovery sent
+
+  UNITY_BEGIN();
+  RUN_TEST(test_round_ends_with_state_all);
+  RUN_TEST(test_once_per_round);
+  return UNITY_END();
+}
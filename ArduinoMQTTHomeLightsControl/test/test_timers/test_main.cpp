@@ -0,0 +1,126 @@
+/*
+ledTimers: arming, re-arming and cancelling timers on the wheel, and when they expire.
+*/
+#include <unity.h>
+#include <Arduino.h>
+#include <TaskManagerIO.h>
+#include "ledTimers.h"
+#include "ledStates.h"
+
+static uint8_t expired[noOfOutputExpanders];
+static uint8_t expiries;   // onExpired calls
+
+static void onExpired(const uint8_t* mask)
+{
+  for (uint8_t e = 0; e < noOfOutputExpanders; e++) expired[e] |= mask[e];
+  expiries++;
+}
+
+static bool hasExpired(uint8_t bit)
+{
+  return expired[bit >> 3] & (1 << (bit & 7));
+}
+
+void setUp()
+{
+  memset(expired, 0, sizeof(expired));
+  expiries = 0;
+}
+
+void tearDown() {}
+
+// whole ticks, so every test starts right after one
+static void runFor(uint32_t seconds)
+{
+  for (uint32_t i = 0; i < seconds * timerTickMs; i++)
+  {
+    shimAdvanceMicros(1000);
+    taskManager.runLoop();
+  }
+}
+
+static void test_expire()
+{
+  ledTimerStart(3, 3);
+  TEST_ASSERT_TRUE(ledTimerArmed(3));
+  runFor(2);
+  TEST_ASSERT_EQUAL_UINT8(0, expiries);
+  runFor(1);
+  TEST_ASSERT_EQUAL_UINT8(1, expiries);
+  TEST_ASSERT_TRUE(hasExpired(3));
+  TEST_ASSERT_FALSE(ledTimerArmed(3));
+  runFor(timerWheelSlots + 1);
+  TEST_ASSERT_EQUAL_UINT8(1, expiries);
+}
+
+static void test_cancel()
+{
+  ledTimerStart(3, 2);
+  ledTimerStart(3, 0);
+  TEST_ASSERT_FALSE(ledTimerArmed(3));
+  runFor(3);
+  TEST_ASSERT_EQUAL_UINT8(0, expiries);
+}
+
+static void test_rearm()
+{
+  ledTimerStart(3, 2);
+  ledTimerStart(3, 5);
+  runFor(4);
+  TEST_ASSERT_EQUAL_UINT8(0, expiries);
+  runFor(1);
+  TEST_ASSERT_EQUAL_UINT8(1, expiries);
+  TEST_ASSERT_TRUE(hasExpired(3));
+}
+
+static void test_later_turn_of_the_wheel()
+{
+  // the same slot, one turn apart
+  ledTimerStart(4, timerWheelSlots + 2);
+  ledTimerStart(5, 2);
+  runFor(2);
+  TEST_ASSERT_TRUE(hasExpired(5));
+  TEST_ASSERT_FALSE(hasExpired(4));
+  TEST_ASSERT_TRUE(ledTimerArmed(4));
+  runFor(timerWheelSlots - 1);
+  TEST_ASSERT_FALSE(hasExpired(4));
+  runFor(1);
+  TEST_ASSERT_TRUE(hasExpired(4));
+  TEST_ASSERT_EQUAL_UINT8(2, expiries);
+}
+
+static void test_cancel_in_a_shared_slot()
+{
+  // one slot list 2 -> 63 -> 40 -> 1; unlinking from the head and the middle keeps the rest
+  ledTimerStart(1, 4);
+  ledTimerStart(40, 4);
+  ledTimerStart(63, 4);
+  ledTimerStart(2, 4);
+  ledTimerStart(40, 0);
+  ledTimerStart(2, 0);
+  runFor(4);
+  TEST_ASSERT_EQUAL_UINT8(1, expiries);
+  const uint8_t expected[noOfOutputExpanders] = {0x02, 0, 0, 0, 0, 0, 0, 0x80};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, expired, noOfOutputExpanders);
+}
+
+static void test_auto_off_time()
+{
+  ledAutoOffSet(6, 300);
+  TEST_ASSERT_EQUAL_UINT16(300, ledAutoOff(6));
+  TEST_ASSERT_EQUAL_UINT16(0, ledAutoOff(7));
+  TEST_ASSERT_EQUAL_UINT16(0, ledAutoOff(noOfLedBits));
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  ledTimersBegin(onExpired);
+  RUN_TEST(test_expire);
+  RUN_TEST(test_cancel);
+  RUN_TEST(test_rearm);
+  RUN_TEST(test_later_turn_of_the_wheel);
+  RUN_TEST(test_cancel_in_a_shared_slot);
+  RUN_TEST(test_auto_off_time);
+  return UNITY_END();
+}